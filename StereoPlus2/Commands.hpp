@@ -53,7 +53,7 @@ protected:
 	virtual bool Execute() {
 		bool res = Scene::MoveTo(static_cast<GroupObject*>(target), targetPos, items, pos);
 
-		items->clear();
+		ObjectSelection::RemoveAll();
 		caller->isCommandEmpty = true;
 
 		callback();
@@ -76,7 +76,7 @@ public:
 
 	SceneObject* target;
 	int targetPos;
-	std::set<PON>* items;
+	const ObjectSelection::Selection* items;
 	InsertPosition pos;
 	IHolder* caller;
 	std::function<void()> callback = [] {};
@@ -4,11 +4,14 @@
 #include <stdlib.h>
 #include <set>
 #include <array>
+#include <climits>
 #include "ImGuiExtensions.hpp"
 #include "DomainUtils.hpp"
 #include <glm/gtx/vector_angle.hpp>
-#include <regex>
+#include <unordered_set>
 #include "Math.hpp"
+#include "LevelOfDetail.hpp"
+#include "ShaderManager.hpp"
 
 class GroupObject : public SceneObject {
 public:
@@ -29,6 +32,22 @@ public:
 };
 
 class LeafObject : public SceneObject {
+protected:
+	// Uploads the data from the given index to the bound buffer.
+	// Grows the buffer geometrically so appended ranges fit without reallocation.
+	// Reallocation loses the contents so the whole range is uploaded then.
+	template<typename T>
+	static void upload(GLenum target, const std::vector<T>& data, size_t from, size_t& capacity) {
+		if (data.size() > capacity) {
+			capacity = data.size() > capacity * 2 ? data.size() : capacity * 2;
+			GLState::BufferData(target, sizeof(T) * capacity, nullptr, GL_DYNAMIC_DRAW);
+			from = 0;
+		}
+
+		if (from < data.size())
+			GLState::BufferSubData(target, sizeof(T) * from, sizeof(T) * (data.size() - from), data.data() + from);
+	}
+
 public:
 	LeafObject() {}
 	LeafObject(const LeafObject* copy) : SceneObject(copy){}
@@ -42,52 +61,60 @@ public:
 class PolyLine : public LeafObject {
 	std::vector<glm::vec3> vertices;
 
-	std::vector<glm::vec3> verticesCache;
-
 	std::vector<glm::vec3> leftBuffer;
 	std::vector<glm::vec3> rightBuffer;
 
+	LevelOfDetail levelOfDetail;
+	// Vertices of the selected level in the buffers.
+	size_t drawnVertexCount = 0;
+
 	virtual void UpdateOpenGLBuffer(
 		std::function<glm::vec3(glm::vec3)> toLeft,
 		std::function<glm::vec3(glm::vec3)> toRight) override {
-		UpdateCache();
-
-		leftBuffer = std::vector<glm::vec3>(verticesCache.size());
-		rightBuffer = std::vector<glm::vec3>(verticesCache.size());
-		for (size_t i = 0; i < verticesCache.size(); i++) {
-			leftBuffer[i] = toLeft(verticesCache[i]);
-			rightBuffer[i] = toRight(verticesCache[i]);
+		// Levels are selected in local space so moving the line doesn't rebuild them.
+		auto toWorld = GetWorldTransform();
+		auto& drawn = levelOfDetail.Select(vertices, toWorld, toLeft);
+		drawnVertexCount = drawn.size();
+
+		leftBuffer = std::vector<glm::vec3>(drawn.size());
+		rightBuffer = std::vector<glm::vec3>(drawn.size());
+		for (size_t i = 0; i < drawn.size(); i++) {
+			auto v = glm::vec3(toWorld * glm::vec4(drawn[i], 1));
+			leftBuffer[i] = toLeft(v);
+			rightBuffer[i] = toRight(v);
 		}
-		glBindBuffer(GL_ARRAY_BUFFER, VBOLeft);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * verticesCache.size(), leftBuffer.data(), GL_DYNAMIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, VBORight);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * verticesCache.size(), rightBuffer.data(), GL_DYNAMIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-	}
-
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VBOLeft);
+		GLState::BufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * drawn.size(), leftBuffer.data(), GL_DYNAMIC_DRAW);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VBORight);
+		GLState::BufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * drawn.size(), rightBuffer.data(), GL_DYNAMIC_DRAW);
 
-	void UpdateCache() {
-		verticesCache = vertices;
-		CascadeTransform(verticesCache);
-		shouldUpdateCache = false;
+		MarkCacheUpdated();
 	}
 
 public:
 
-	PolyLine() {}
+	PolyLine() {
+		levelOfDetail.SetOnBuilt([&] { shouldUpdateCache = true; });
+	}
 	PolyLine(const PolyLine* copy) : LeafObject(copy){
+		levelOfDetail.SetOnBuilt([&] { shouldUpdateCache = true; });
 		vertices = copy->vertices;
 	}
 
 	virtual ObjectType GetType() const override {
 		return PolyLineT;
 	}
+	// Traces consist of clones with the same vertices.
+	virtual bool IsInstanceable() const override {
+		return GetParent() && GetParent()->GetType() == TraceObjectT;
+	}
 	virtual const std::vector<glm::vec3>& GetVertices() const override {
 		return vertices;
 	}
 
 	virtual void AddVertice(const glm::vec3& v) override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		vertices.push_back(v);
 		shouldUpdateCache = true;
 	}
@@ -97,26 +124,31 @@ public:
 	}
 	virtual void SetVertice(size_t index, const glm::vec3& v) override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		vertices[index] = v;
 		shouldUpdateCache = true;
 	}
 	virtual void SetVerticeX(size_t index, const float& v) override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		vertices[index].x = v;
 		shouldUpdateCache = true;
 	}
 	virtual void SetVerticeY(size_t index, const float& v) override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		vertices[index].y = v;
 		shouldUpdateCache = true;
 	}
 	virtual void SetVerticeZ(size_t index, const float& v) override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		vertices[index].z = v;
 		shouldUpdateCache = true;
 	}
 	virtual void SetVertices(const std::vector<glm::vec3>& vs) override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		vertices.clear();
 		for (auto v : vs)
 			AddVertice(v);
@@ -125,6 +157,7 @@ public:
 
 	virtual void RemoveVertice() override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		if (vertices.size() > 0)
 			vertices.pop_back();
 		shouldUpdateCache = true;
@@ -147,36 +180,25 @@ public:
 
 	virtual void Reset() override {
 		vertices.clear();
+		levelOfDetail.Invalidate();
 		SceneObject::Reset();
 	}
 
 	virtual void DrawLeft(GLuint shader) override {
-		if (verticesCache.size() < 2)
+		if (drawnVertexCount < 2)
 			return;
 
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBOLeft);
-		glVertexAttribPointer(GL_POINTS, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-		glEnableVertexAttribArray(GL_POINTS);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		// Apply shader
-		glUseProgram(shader);
-		glDrawArrays(GL_LINE_STRIP, 0, verticesCache.size());
+		GLState::BindVertexArray(VAOLeft);
+		GLState::UseProgram(shader);
+		GLState::DrawArrays(GL_LINE_STRIP, 0, drawnVertexCount);
 	}
 	virtual void DrawRight(GLuint shader) override {
-		if (verticesCache.size() < 2)
+		if (drawnVertexCount < 2)
 			return;
 
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBORight);
-		glVertexAttribPointer(GL_POINTS, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-		glEnableVertexAttribArray(GL_POINTS);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		// Apply shader
-		glUseProgram(shader);
-		glDrawArrays(GL_LINE_STRIP, 0, GetVertices().size());
+		GLState::BindVertexArray(VAORight);
+		GLState::UseProgram(shader);
+		GLState::DrawArrays(GL_LINE_STRIP, 0, drawnVertexCount);
 	}
 
 	SceneObject* Clone() const override {
@@ -184,6 +206,7 @@ public:
 	}
 	PolyLine& operator=(const PolyLine& o) {
 		vertices = o.vertices;
+		levelOfDetail.Invalidate();
 		LeafObject::operator=(o);
 		return *this;
 	}
@@ -195,33 +218,37 @@ class SineCurve : public LeafObject {
 	std::vector<glm::vec3> vertices;
 	bool isPositionCreated = false;
 
+	// The curve built from the vertices in local space.
 	std::vector<glm::vec3> verticesCache;
 
 	std::vector<glm::vec3> leftBuffer;
 	std::vector<glm::vec3> rightBuffer;
 
+	LevelOfDetail levelOfDetail;
+	// Vertices of the selected level in the buffers.
+	size_t drawnVertexCount = 0;
+
 	virtual void UpdateOpenGLBuffer(
 		std::function<glm::vec3(glm::vec3)> toLeft,
 		std::function<glm::vec3(glm::vec3)> toRight) override {
 		UpdateCache();
 
-		leftBuffer = std::vector<glm::vec3>(verticesCache.size());
-		rightBuffer = std::vector<glm::vec3>(verticesCache.size());
-		for (size_t i = 0; i < verticesCache.size(); i++) {
-			leftBuffer[i] = toLeft(verticesCache[i]);
-			rightBuffer[i] = toRight(verticesCache[i]);
+		// Levels are selected in local space so moving the curve doesn't rebuild them.
+		auto toWorld = GetWorldTransform();
+		auto& drawn = levelOfDetail.Select(verticesCache, toWorld, toLeft);
+		drawnVertexCount = drawn.size();
+
+		leftBuffer = std::vector<glm::vec3>(drawn.size());
+		rightBuffer = std::vector<glm::vec3>(drawn.size());
+		for (size_t i = 0; i < drawn.size(); i++) {
+			auto v = glm::vec3(toWorld * glm::vec4(drawn[i], 1));
+			leftBuffer[i] = toLeft(v);
+			rightBuffer[i] = toRight(v);
 		}
-		glBindBuffer(GL_ARRAY_BUFFER, VBOLeft);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * verticesCache.size(), leftBuffer.data(), GL_DYNAMIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, VBORight);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * verticesCache.size(), rightBuffer.data(), GL_DYNAMIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-	}
-
-	void updateCacheAsPolyLine() {
-		verticesCache = vertices;
-		CascadeTransform(verticesCache);
-		shouldUpdateCache = false;
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VBOLeft);
+		GLState::BufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * drawn.size(), leftBuffer.data(), GL_DYNAMIC_DRAW);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VBORight);
+		GLState::BufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * drawn.size(), rightBuffer.data(), GL_DYNAMIC_DRAW);
 	}
 
 	void updateCacheAsPolyLine(int from, int to) {
@@ -248,10 +275,9 @@ void UpdateCache() {
 
 	if (vertices.size() < 3) {
 		updateCacheAsPolyLine(0, vertices.size());
-		CascadeTransform(verticesCache);
 
 		// Remove all cache update requests.
-		shouldUpdateCache = false;
+		MarkCacheUpdated();
 
 		return;
 	}
@@ -268,18 +294,18 @@ void UpdateCache() {
 		verticesCache.insert(verticesCache.end(), points.begin(), points.end());
 	}
 
-	CascadeTransform(verticesCache);
-
 	// Remove all cache update requests.
-	shouldUpdateCache = false;
+	MarkCacheUpdated();
 	return;
 }
 
 public:
 
 	SineCurve() {
+		levelOfDetail.SetOnBuilt([&] { shouldUpdateCache = true; });
 	}
 	SineCurve(const SineCurve* copy) : LeafObject(copy) {
+		levelOfDetail.SetOnBuilt([&] { shouldUpdateCache = true; });
 		vertices = copy->vertices;
 	}
 
@@ -292,6 +318,7 @@ public:
 
 	virtual void AddVertice(const glm::vec3& v) override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		vertices.push_back(v);
 		shouldUpdateCache = true;
 	}
@@ -301,26 +328,31 @@ public:
 	}
 	virtual void SetVertice(size_t index, const glm::vec3& v) override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		vertices[index] = v;
 		shouldUpdateCache = true;
 	}
 	virtual void SetVerticeX(size_t index, const float& v) override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		vertices[index].x = v;
 		shouldUpdateCache = true;
 	}
 	virtual void SetVerticeY(size_t index, const float& v) override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		vertices[index].y = v;
 		shouldUpdateCache = true;
 	}
 	virtual void SetVerticeZ(size_t index, const float& v) override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		vertices[index].z = v;
 		shouldUpdateCache = true;
 	}
 	virtual void SetVertices(const std::vector<glm::vec3>& vs) override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		vertices.clear();
 		for (auto v : vs)
 			AddVertice(v);
@@ -329,6 +361,7 @@ public:
 
 	virtual void RemoveVertice() override {
 		HandleBeforeUpdate();
+		levelOfDetail.Invalidate();
 		if (vertices.size() > 0)
 			vertices.pop_back();
 		shouldUpdateCache = true;
@@ -351,36 +384,25 @@ public:
 
 	virtual void Reset() override {
 		vertices.clear();
+		levelOfDetail.Invalidate();
 		SceneObject::Reset();
 	}
 
 	virtual void DrawLeft(GLuint shader) override {
-		if (verticesCache.size() < 2)
+		if (drawnVertexCount < 2)
 			return;
 
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBOLeft);
-		glVertexAttribPointer(GL_POINTS, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-		glEnableVertexAttribArray(GL_POINTS);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		// Apply shader
-		glUseProgram(shader);
-		glDrawArrays(GL_LINE_STRIP, 0, verticesCache.size());
+		GLState::BindVertexArray(VAOLeft);
+		GLState::UseProgram(shader);
+		GLState::DrawArrays(GL_LINE_STRIP, 0, drawnVertexCount);
 	}
 	virtual void DrawRight(GLuint shader) override {
-		if (verticesCache.size() < 2)
+		if (drawnVertexCount < 2)
 			return;
 
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBORight);
-		glVertexAttribPointer(GL_POINTS, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-		glEnableVertexAttribArray(GL_POINTS);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		// Apply shader
-		glUseProgram(shader);
-		glDrawArrays(GL_LINE_STRIP, 0, verticesCache.size());
+		GLState::BindVertexArray(VAORight);
+		GLState::UseProgram(shader);
+		GLState::DrawArrays(GL_LINE_STRIP, 0, drawnVertexCount);
 	}
 
 	SceneObject* Clone() const override {
@@ -388,6 +410,7 @@ public:
 	}
 	SineCurve& operator=(const SineCurve& o) {
 		vertices = o.vertices;
+		levelOfDetail.Invalidate();
 		LeafObject::operator=(o);
 		return *this;
 	}
@@ -404,82 +427,108 @@ private:
 
 	GLuint IBO;
 
-	bool shouldUpdateIBO = true;
+	// Vertices and connections before these counts are uploaded and unchanged.
+	// Extrusion rings are appended to the end so only the rest is uploaded.
+	size_t validVertexCount = 0;
+	size_t validConnectionCount = 0;
+	// Allocated sizes of the buffers in elements.
+	size_t vertexCapacity = 0;
+	size_t connectionCapacity = 0;
+	uint64_t uploadedTransformGeneration = 0;
+
+	void invalidateVertices(size_t from = 0) {
+		if (validVertexCount > from)
+			validVertexCount = from;
+	}
+	void invalidateConnections(size_t from = 0) {
+		if (validConnectionCount > from)
+			validConnectionCount = from;
+	}
 
 	virtual void UpdateOpenGLBuffer(
 		std::function<glm::vec3(glm::vec3)> toLeft,
 		std::function<glm::vec3(glm::vec3)> toRight) override {
-		UpdateCache();
+		// The camera moves every vertex.
+		if (uploadedTransformGeneration != GetTransformGeneration() || Settings::ShouldDetectPosition().Get())
+			invalidateVertices();
+		uploadedTransformGeneration = GetTransformGeneration();
+
+		auto from = validVertexCount;
+		UpdateCache(from);
 
-		leftBuffer = rightBuffer = std::vector<glm::vec3>(vertexCache.size());
-		for (size_t i = 0; i < vertexCache.size(); i++) {
+		leftBuffer.resize(vertexCache.size());
+		rightBuffer.resize(vertexCache.size());
+		for (size_t i = from; i < vertexCache.size(); i++) {
 			leftBuffer[i] = toLeft(vertexCache[i]);
 			rightBuffer[i] = toRight(vertexCache[i]);
 		}
 
-		glBindBuffer(GL_ARRAY_BUFFER, VBOLeft);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertexCache.size(), leftBuffer.data(), GL_DYNAMIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, VBORight);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertexCache.size(), rightBuffer.data(), GL_DYNAMIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		if (shouldUpdateIBO) {
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(std::array<GLuint, 2>) * GetLinearConnections().size(), GetLinearConnections().data(), GL_DYNAMIC_DRAW);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-			shouldUpdateIBO = false;
+		// Both vertex buffers grow together.
+		auto leftCapacity = vertexCapacity;
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VBOLeft);
+		upload(GL_ARRAY_BUFFER, leftBuffer, from, leftCapacity);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VBORight);
+		upload(GL_ARRAY_BUFFER, rightBuffer, from, vertexCapacity);
+		validVertexCount = vertexCache.size();
+
+		if (validConnectionCount < connections.size()) {
+			// Element array binding belongs to the vertex array.
+			GLState::BindVertexArray(VAOLeft);
+			upload(GL_ELEMENT_ARRAY_BUFFER, connections, validConnectionCount, connectionCapacity);
+			validConnectionCount = connections.size();
 		}
 	}
 
-	void UpdateCache() {
-		vertexCache = vertices;
-		CascadeTransform(vertexCache);
-		shouldUpdateCache = false;
+	// Only vertices from the given index are transformed again.
+	void UpdateCache(size_t from = 0) {
+		std::vector<glm::vec3> changed(vertices.begin() + from, vertices.end());
+		CascadeTransform(changed);
+
+		vertexCache.resize(from);
+		vertexCache.insert(vertexCache.end(), changed.begin(), changed.end());
+		MarkCacheUpdated();
 	}
 
 	virtual void DrawLeft(GLuint shader) override {
 		if (vertexCache.size() < 2)
 			return;
 
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBOLeft);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-		glVertexAttribPointer(GL_POINTS, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-		glEnableVertexAttribArray(GL_POINTS);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		// Apply shader
-		glUseProgram(shader);
-		glDrawElements(GL_LINES, GetLinearConnections().size() * 2, GL_UNSIGNED_INT, nullptr);
+		GLState::BindVertexArray(VAOLeft);
+		GLState::UseProgram(shader);
+		GLState::DrawElements(GL_LINES, GetLinearConnections().size() * 2, GL_UNSIGNED_INT, nullptr);
 	}
 	virtual void DrawRight(GLuint shader) override {
 		if (vertexCache.size() < 2)
 			return;
 
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBORight);
-		glVertexAttribPointer(GL_POINTS, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-		glEnableVertexAttribArray(GL_POINTS);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		GLState::BindVertexArray(VAORight);
+		GLState::UseProgram(shader);
+		GLState::DrawElements(GL_LINES, GetLinearConnections().size() * 2, GL_UNSIGNED_INT, nullptr);
+	}
 
-		// Apply shader
-		glUseProgram(shader);
-		glDrawElements(GL_LINES, GetLinearConnections().size() * 2, GL_UNSIGNED_INT, nullptr);
+	void CreateIBO() {
+		glGenBuffers(1, &IBO);
+
+		for (auto vao : { VAOLeft, VAORight }) {
+			GLState::BindVertexArray(vao);
+			GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+		}
+		GLState::BindVertexArray(0);
 	}
 
 public:
 	Mesh() {
-		glGenBuffers(1, &IBO);
+		CreateIBO();
 	}
 	Mesh(const Mesh* copy) : LeafObject(copy) {
-		glGenBuffers(1, &IBO);
+		CreateIBO();
 
 		vertices = copy->vertices;
 		connections = copy->connections;
 	}
 
 	~Mesh() {
-		glDeleteBuffers(1, &IBO);
+		GLState::DeleteBuffers(1, &IBO);
 	}
 
 	virtual ObjectType GetType() const override {
@@ -493,7 +542,6 @@ public:
 		HandleBeforeUpdate();
 		connections.push_back({ p1, p2 });
 		shouldUpdateCache = true;
-		shouldUpdateIBO = true;
 	}
 	virtual void Disconnect(GLuint p1, GLuint p2) {
 		auto pos = find(connections, std::array<GLuint, 2>{ p1, p2 });
@@ -503,8 +551,8 @@ public:
 
 		HandleBeforeUpdate();
 		connections.erase(connections.begin() + pos);
+		invalidateConnections(pos);
 		shouldUpdateCache = true;
-		shouldUpdateIBO = true;
 	}
 
 	const std::vector<std::array<GLuint, 2>>& GetLinearConnections() {
@@ -518,7 +566,6 @@ public:
 		HandleBeforeUpdate();
 		vertices.push_back(v);
 		shouldUpdateCache = true;
-		shouldUpdateIBO = true;
 	}
 	virtual void AddVertices(const std::vector<glm::vec3>& vs) override {
 		for (auto v : vs)
@@ -527,39 +574,44 @@ public:
 	virtual void SetVertice(size_t index, const glm::vec3& v) override {
 		HandleBeforeUpdate();
 		vertices[index] = v;
+		invalidateVertices(index);
 		shouldUpdateCache = true;
 	}
 	virtual void SetVerticeX(size_t index, const float& v) override {
 		HandleBeforeUpdate();
 		vertices[index].x = v;
+		invalidateVertices(index);
 		shouldUpdateCache = true;
 	}
 	virtual void SetVerticeY(size_t index, const float& v) override {
 		HandleBeforeUpdate();
 		vertices[index].y = v;
+		invalidateVertices(index);
 		shouldUpdateCache = true;
 	}
 	virtual void SetVerticeZ(size_t index, const float& v) override {
 		HandleBeforeUpdate();
 		vertices[index].z = v;
+		invalidateVertices(index);
 		shouldUpdateCache = true;
 	}
 	virtual void SetVertices(const std::vector<glm::vec3>& vs) override {
 		HandleBeforeUpdate();
 		vertices = vs;
+		invalidateVertices();
 		shouldUpdateCache = true;
 	}
 	virtual void SetConnections(const std::vector<std::array<GLuint, 2>>& connections) {
 		HandleBeforeUpdate();
 		this->connections = connections;
+		invalidateConnections();
 		shouldUpdateCache = true;
-		shouldUpdateIBO = true;
 	}
 	virtual void RemoveVertice() override {
 		HandleBeforeUpdate();
 		vertices.pop_back();
+		invalidateVertices(vertices.size());
 		shouldUpdateCache = true;
-		shouldUpdateIBO = true;
 	}
 
 	virtual void DesignProperties() override {
@@ -580,7 +632,8 @@ public:
 	virtual void Reset() override {
 		vertices.clear();
 		connections.clear();
-		shouldUpdateIBO = true;
+		invalidateVertices();
+		invalidateConnections();
 		SceneObject::Reset();
 	}
 
@@ -591,12 +644,317 @@ public:
 	Mesh& operator=(const Mesh& o) {
 		vertices = o.vertices;
 		connections = o.connections;
+		invalidateVertices();
+		invalidateConnections();
 		LeafObject::operator=(o);
 		return *this;
 	}
 
 };
 
+// Mesh made of rows of the same number of vertices, e.g. rings of an extrusion.
+// Each row is connected along itself and to the same vertices of the previous row
+// so connections aren't stored, they are taken from an index buffer shared by all grids
+// with the same number of columns.
+struct GridMesh : LeafObject {
+private:
+	// Index buffer of a column count that covers the given number of rows.
+	// Rows are connected in order so the indices of fewer rows are a prefix of it.
+	struct GridIndices {
+		GLuint IBO = 0;
+		size_t rows = 0;
+	};
+
+	std::vector<glm::vec3> vertices;
+	size_t columns = 0;
+
+	std::vector<glm::vec3> vertexCache;
+	std::vector<glm::vec3> leftBuffer;
+	std::vector<glm::vec3> rightBuffer;
+
+	// Vertices before this count are uploaded and unchanged.
+	size_t validVertexCount = 0;
+	size_t vertexCapacity = 0;
+	uint64_t uploadedTransformGeneration = 0;
+
+	static std::map<size_t, GridIndices>& gridIndices() {
+		static std::map<size_t, GridIndices> v;
+		return v;
+	}
+
+	static size_t getConnectionCount(size_t columns, size_t rows) {
+		return rows == 0 ? 0 : rows * (columns - 1) + (rows - 1) * columns;
+	}
+
+	static GridIndices& getIndices(size_t columns) {
+		auto& indices = gridIndices()[columns];
+		if (indices.IBO == 0)
+			glGenBuffers(1, &indices.IBO);
+
+		return indices;
+	}
+
+	// Grows the shared buffer geometrically so extruding uploads indices only a few times.
+	// The buffer keeps its name so vertex arrays of other grids still refer to it.
+	static void reserveIndices(size_t columns, size_t rows) {
+		auto& indices = getIndices(columns);
+		if (rows <= indices.rows)
+			return;
+
+		indices.rows = rows > indices.rows * 2 ? rows : indices.rows * 2;
+
+		std::vector<std::array<GLuint, 2>> connections;
+		connections.reserve(getConnectionCount(columns, indices.rows));
+		for (GLuint r = 0; r < indices.rows; r++)
+			for (GLuint i = 0; i < columns; i++) {
+				auto v = r * (GLuint)columns + i;
+				if (r > 0)
+					connections.push_back({ v - (GLuint)columns, v });
+				if (i > 0)
+					connections.push_back({ v - 1, v });
+			}
+
+		// Buffers aren't typed so the element array binding of the vertex arrays isn't touched.
+		GLState::BindBuffer(GL_ARRAY_BUFFER, indices.IBO);
+		GLState::BufferData(GL_ARRAY_BUFFER, sizeof(std::array<GLuint, 2>) * connections.size(), connections.data(), GL_STATIC_DRAW);
+	}
+
+	void invalidateVertices(size_t from = 0) {
+		if (validVertexCount > from)
+			validVertexCount = from;
+	}
+
+	void bindIndices() {
+		if (columns == 0)
+			return;
+
+		for (auto vao : { VAOLeft, VAORight }) {
+			GLState::BindVertexArray(vao);
+			GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, getIndices(columns).IBO);
+		}
+		GLState::BindVertexArray(0);
+	}
+
+	virtual void UpdateOpenGLBuffer(
+		std::function<glm::vec3(glm::vec3)> toLeft,
+		std::function<glm::vec3(glm::vec3)> toRight) override {
+		// The camera moves every vertex.
+		if (uploadedTransformGeneration != GetTransformGeneration() || Settings::ShouldDetectPosition().Get())
+			invalidateVertices();
+		uploadedTransformGeneration = GetTransformGeneration();
+
+		auto from = validVertexCount;
+		UpdateCache(from);
+
+		leftBuffer.resize(vertexCache.size());
+		rightBuffer.resize(vertexCache.size());
+		for (size_t i = from; i < vertexCache.size(); i++) {
+			leftBuffer[i] = toLeft(vertexCache[i]);
+			rightBuffer[i] = toRight(vertexCache[i]);
+		}
+
+		// Both vertex buffers grow together.
+		auto leftCapacity = vertexCapacity;
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VBOLeft);
+		upload(GL_ARRAY_BUFFER, leftBuffer, from, leftCapacity);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VBORight);
+		upload(GL_ARRAY_BUFFER, rightBuffer, from, vertexCapacity);
+		validVertexCount = vertexCache.size();
+
+		if (columns > 0)
+			reserveIndices(columns, GetRows());
+	}
+
+	// Only vertices from the given index are transformed again.
+	void UpdateCache(size_t from = 0) {
+		std::vector<glm::vec3> changed(vertices.begin() + from, vertices.end());
+		CascadeTransform(changed);
+
+		vertexCache.resize(from);
+		vertexCache.insert(vertexCache.end(), changed.begin(), changed.end());
+		MarkCacheUpdated();
+	}
+
+	void draw(GLuint vao, GLuint shader) {
+		auto count = columns > 0 ? getConnectionCount(columns, GetRows()) : 0;
+		if (count == 0)
+			return;
+
+		GLState::BindVertexArray(vao);
+		GLState::UseProgram(shader);
+		GLState::DrawElements(GL_LINES, count * 2, GL_UNSIGNED_INT, nullptr);
+	}
+	virtual void DrawLeft(GLuint shader) override {
+		draw(VAOLeft, shader);
+	}
+	virtual void DrawRight(GLuint shader) override {
+		draw(VAORight, shader);
+	}
+
+public:
+	GridMesh() {}
+	GridMesh(const GridMesh* copy) : LeafObject(copy) {
+		// Copies are made by the state buffer while undoing so they don't notify.
+		vertices = copy->vertices;
+		columns = copy->columns;
+		bindIndices();
+	}
+
+	virtual ObjectType GetType() const override {
+		return GridMeshT;
+	}
+
+	size_t GetColumns() const {
+		return columns;
+	}
+	// Vertices of an incomplete last row aren't connected.
+	size_t GetRows() const {
+		return columns > 0 ? vertices.size() / columns : 0;
+	}
+	// Changes only how the vertices are connected.
+	void SetColumns(size_t v) {
+		if (columns == v)
+			return;
+
+		HandleBeforeUpdate();
+		columns = v;
+		bindIndices();
+		shouldUpdateCache = true;
+	}
+
+	virtual const std::vector<glm::vec3>& GetVertices() const override {
+		return vertices;
+	}
+	virtual void AddVertice(const glm::vec3& v) override {
+		HandleBeforeUpdate();
+		vertices.push_back(v);
+		shouldUpdateCache = true;
+	}
+	virtual void AddVertices(const std::vector<glm::vec3>& vs) override {
+		HandleBeforeUpdate();
+		vertices.insert(vertices.end(), vs.begin(), vs.end());
+		shouldUpdateCache = true;
+	}
+	virtual void SetVertice(size_t index, const glm::vec3& v) override {
+		HandleBeforeUpdate();
+		vertices[index] = v;
+		invalidateVertices(index);
+		shouldUpdateCache = true;
+	}
+	virtual void SetVerticeX(size_t index, const float& v) override {
+		HandleBeforeUpdate();
+		vertices[index].x = v;
+		invalidateVertices(index);
+		shouldUpdateCache = true;
+	}
+	virtual void SetVerticeY(size_t index, const float& v) override {
+		HandleBeforeUpdate();
+		vertices[index].y = v;
+		invalidateVertices(index);
+		shouldUpdateCache = true;
+	}
+	virtual void SetVerticeZ(size_t index, const float& v) override {
+		HandleBeforeUpdate();
+		vertices[index].z = v;
+		invalidateVertices(index);
+		shouldUpdateCache = true;
+	}
+	virtual void SetVertices(const std::vector<glm::vec3>& vs) override {
+		HandleBeforeUpdate();
+		vertices = vs;
+		invalidateVertices();
+		shouldUpdateCache = true;
+	}
+	virtual void RemoveVertice() override {
+		HandleBeforeUpdate();
+		vertices.pop_back();
+		invalidateVertices(vertices.size());
+		shouldUpdateCache = true;
+	}
+
+	// Appends a row moved by the offset. The first row sets the number of columns.
+	void AppendExtrusionRing(const std::vector<glm::vec3>& ring, const glm::vec3& offset) {
+		if (ring.empty())
+			return;
+
+		if (columns == 0)
+			SetColumns(ring.size());
+		else if (ring.size() != columns) {
+			Log::For<GridMesh>().Warning("Ring of ", ring.size(), " points can't be added to a grid of ", columns, " columns");
+			return;
+		}
+
+		HandleBeforeUpdate();
+
+		if (vertices.capacity() < vertices.size() + columns)
+			vertices.reserve((vertices.size() + columns) * 2);
+		for (auto& v : ring)
+			vertices.push_back(v + offset);
+
+		shouldUpdateCache = true;
+	}
+	// Moves the last row, e.g. while the pen is held.
+	void SetLastExtrusionRing(const std::vector<glm::vec3>& ring, const glm::vec3& offset) {
+		if (ring.size() != columns || GetRows() == 0)
+			return;
+
+		HandleBeforeUpdate();
+
+		auto first = vertices.size() - columns;
+		for (size_t i = 0; i < columns; i++)
+			vertices[first + i] = ring[i] + offset;
+
+		invalidateVertices(first);
+		shouldUpdateCache = true;
+	}
+	void RemoveExtrusionRing() {
+		if (GetRows() == 0)
+			return;
+
+		HandleBeforeUpdate();
+		vertices.resize(vertices.size() - columns);
+		invalidateVertices(vertices.size());
+		shouldUpdateCache = true;
+	}
+
+	virtual void DesignProperties() override {
+		if (ImGui::TreeNodeEx("grid mesh", ImGuiTreeNodeFlags_DefaultOpen)) {
+			ImGui::Indent(propertyIndent);
+
+			std::stringstream ss;
+			ss << GetRows() << " x " << columns;
+			ImGui::LabelText("rows x columns", ss.str().c_str());
+
+			ss.str("");
+			ss << (columns > 0 ? getConnectionCount(columns, GetRows()) : 0);
+			ImGui::LabelText("line count", ss.str().c_str());
+
+			ImGui::Unindent(propertyIndent);
+			ImGui::TreePop();
+		}
+		SceneObject::DesignProperties();
+	}
+
+	virtual void Reset() override {
+		vertices.clear();
+		columns = 0;
+		invalidateVertices();
+		SceneObject::Reset();
+	}
+
+	SceneObject* Clone() const override {
+		return new GridMesh(this);
+	}
+	GridMesh& operator=(const GridMesh& o) {
+		vertices = o.vertices;
+		columns = o.columns;
+		bindIndices();
+		invalidateVertices();
+		LeafObject::operator=(o);
+		return *this;
+	}
+};
+
 class WhiteSquare
 {
 public:
@@ -613,20 +971,35 @@ public:
 	GLuint VBORightBottom, VAORightBottom;
 	GLuint ShaderProgram;
 
+	void Draw() const {
+		Draw(ShaderProgram);
+	}
+	// Covers the whole view with another program, e.g. to compose images.
+	void Draw(GLuint program) const {
+		GLState::BindVertexArray(VAOLeftTop);
+		GLState::UseProgram(program);
+		GLState::DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+
 
 	bool Init()
 	{
 
-		auto vertexShaderSource = GLLoader::ReadShader("shaders/.vert");
-		auto fragmentShaderSource = GLLoader::ReadShader("shaders/WhiteSquare.frag");
-
-		ShaderProgram = GLLoader::CreateShaderProgram(vertexShaderSource.c_str(), fragmentShaderSource.c_str());
+		ShaderManager::Load(ShaderProgram, { "shaders/.vert", "shaders/WhiteSquare.frag" });
 
 		glGenVertexArrays(1, &VAOLeftTop);
 		glGenBuffers(1, &VBOLeftTop);
 		glGenVertexArrays(1, &VAORightBottom);
 		glGenBuffers(1, &VBORightBottom);
 
+		// The square never changes so it is uploaded once.
+		GLState::BindVertexArray(VAOLeftTop);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VBOLeftTop);
+		GLState::BufferData(GL_ARRAY_BUFFER, VerticesSize, vertices, GL_STATIC_DRAW);
+		glVertexAttribPointer(GL_POINTS, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(GL_POINTS);
+		GLState::BindVertexArray(0);
+
 		return true;
 	}
 };
@@ -648,11 +1021,10 @@ class Cross : public LeafObject {
 			rightBuffer[i] = toRight(vertices[i]);
 		}
 
-		glBindBuffer(GL_ARRAY_BUFFER, VBOLeft);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertices.size(), leftBuffer.data(), GL_STREAM_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, VBORight);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertices.size(), rightBuffer.data(), GL_STREAM_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VBOLeft);
+		GLState::BufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertices.size(), leftBuffer.data(), GL_STREAM_DRAW);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VBORight);
+		GLState::BufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertices.size(), rightBuffer.data(), GL_STREAM_DRAW);
 	}
 
 
@@ -669,7 +1041,7 @@ class Cross : public LeafObject {
 		vertices[5].z += size;
 
 		CascadeTransform(vertices);
-		shouldUpdateCache = false;
+		MarkCacheUpdated();
 	}
 
 	// Cross is being continuously modified so don't notify it's updates.
@@ -713,26 +1085,14 @@ public:
 	}
 
 	virtual void DrawLeft(GLuint shader) override {
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBOLeft);
-		glVertexAttribPointer(GL_POINTS, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-		glEnableVertexAttribArray(GL_POINTS);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		// Apply shader
-		glUseProgram(shader);
-		glDrawArrays(GL_LINES, 0, vertices.size());
+		GLState::BindVertexArray(VAOLeft);
+		GLState::UseProgram(shader);
+		GLState::DrawArrays(GL_LINES, 0, vertices.size());
 	}
 	virtual void DrawRight(GLuint shader) override {
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBORight);
-		glVertexAttribPointer(GL_POINTS, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-		glEnableVertexAttribArray(GL_POINTS);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		// Apply shader
-		glUseProgram(shader);
-		glDrawArrays(GL_LINES, 0, vertices.size());
+		GLState::BindVertexArray(VAORight);
+		GLState::UseProgram(shader);
+		GLState::DrawArrays(GL_LINES, 0, vertices.size());
 	}
 };
 
@@ -762,6 +1122,7 @@ public:
 
 	Camera() {
 		Name = "camera";
+		ListenToAncestorChanges();
 		EyeToCenterDistance.OnChanged() += [&](const float& v) {
 			eyeToCenterDistance = Convert::MillimetersToViewCoordinates(v, ViewSize->x); };
 		PositionModifier.OnChanged() += [&](const glm::vec3& v) {
@@ -778,6 +1139,18 @@ public:
 		return onPropertiesChanged;
 	}
 
+	// Parameters of GetLeft and GetRight for projecting in the vertex shader.
+	glm::vec3 GetViewPosition() {
+		return GetPos();
+	}
+	float GetViewEyeToCenterDistance() const {
+		return eyeToCenterDistance;
+	}
+	// The conversion is linear so it is the same for every vertex.
+	glm::vec3 GetMillimetersToView() {
+		return Convert::MillimetersToViewCoordinates(glm::vec3(1), ViewSize.Get(), viewSizeZ);
+	}
+
 	glm::vec3 GetLeft(const glm::vec3& v) {
 		return Stereo::GetLeft(v, GetPos(), eyeToCenterDistance, ViewSize.Get(), viewSizeZ);
 	}
@@ -819,13 +1192,17 @@ public:
 };
 
 class TraceObject : public GroupObject {
-	bool shouldIgnoreParent;
+	bool shouldIgnoreParent = false;
 	virtual void HandleBeforeUpdate() override {
 		GroupObject::HandleBeforeUpdate();
 		shouldIgnoreParent = false;
 	}
 
 public:
+	TraceObject() {
+		ListenToAncestorChanges();
+	}
+
 	void IgnoreParentOnce() {
 		shouldIgnoreParent = true;
 	}
@@ -840,6 +1217,68 @@ public:
 	
 };
 
+// Keeps track of the numeric suffixes used by object names of the form "<base> <index>"
+// so a free name can be generated without scanning the whole scene.
+class NameRegistry {
+	// Base name -> (index -> number of objects using it).
+	std::unordered_map<std::string, std::map<int, int>> used;
+
+	static bool Split(const std::string& name, std::string& base, int& index) {
+		auto space = name.find_last_of(' ');
+		if (space == std::string::npos || space + 1 == name.size())
+			return false;
+
+		index = 0;
+		for (auto i = space + 1; i < name.size(); i++) {
+			if (name[i] < '0' || name[i] > '9')
+				return false;
+			// Suffixes that don't fit are a part of the base name.
+			if (index > (INT_MAX - (name[i] - '0')) / 10)
+				return false;
+			index = index * 10 + (name[i] - '0');
+		}
+
+		base = name.substr(0, space);
+		return true;
+	}
+public:
+	void Add(const std::string& name) {
+		std::string base;
+		int index;
+		if (Split(name, base, index))
+			used[base][index]++;
+	}
+	void Remove(const std::string& name) {
+		std::string base;
+		int index;
+		if (!Split(name, base, index))
+			return;
+
+		auto b = used.find(base);
+		if (b == used.end())
+			return;
+
+		auto i = b->second.find(index);
+		if (i == b->second.end())
+			return;
+
+		if (--i->second == 0)
+			b->second.erase(i);
+		if (b->second.empty())
+			used.erase(b);
+	}
+	void Clear() {
+		used.clear();
+	}
+	int GetNextIndex(const std::string& base) const {
+		auto b = used.find(base);
+		if (b == used.end())
+			return 1;
+
+		return b->second.rbegin()->first + 1;
+	}
+};
+
 class Scene {
 	Log Logger = Log::For<Scene>();
 
@@ -876,6 +1315,16 @@ class Scene {
 		return FindConnectedParent(const_cast<SceneObject*>(oldParent->GetParent()), disconnectedItemsToBeMoved);
 	}
 
+	static NameRegistry& names() {
+		static NameRegistry v;
+		return v;
+	}
+	static void RebuildNames() {
+		names().Clear();
+		for (auto& o : Objects().Get())
+			names().Add(o->Name);
+	}
+
 	static PON CreateRoot() {
 		auto r = new GroupObject();
 		r->Name = "Root";
@@ -898,17 +1347,33 @@ public:
 
 	Scene() {
 		root() = CreateRoot();
+
+		// Undo and redo replace the object list with restored copies.
+		StateBuffer::OnStateChange() += [] {
+			RebuildNames();
+		};
 	}
 
 	static bool Insert(SceneObject* destination, SceneObject* obj) {
 		obj->SetParent(destination);
 		Objects().Get().push_back(obj);
+		Objects().Get().back().SetInScene(true);
+		names().Add(obj->Name);
 		return true;
 	}
 	static bool Insert(SceneObject* obj) {
-		obj->SetParent(root().Get().Get());
-		Objects().Get().push_back(obj);
-		return true;
+		return Insert(root().Get().Get(), obj);
+	}
+	// Replaces all scene objects with the loaded ones.
+	static void SetObjects(const std::vector<PON>& objects) {
+		for (auto& o : Objects().Get())
+			o.SetInScene(false);
+		for (auto& o : objects)
+			o.SetInScene(true);
+
+		Objects() = objects;
+		RebuildNames();
+		SceneObject::HierarchyVersion()++;
 	}
 
 	static bool Delete(SceneObject* source, SceneObject* obj) {
@@ -917,32 +1382,76 @@ public:
 			return true;
 		}
 
-		for (size_t i = 0; i < source->children.size(); i++)
-			if (source->children[i] == obj)
-				for (size_t j = 0; i < Objects()->size(); j++)
-					if (Objects().Get()[j].Get() == obj) {
-						source->children.erase(source->children.begin() + i);
-						Objects().Get().erase(Objects()->begin() + j);
-						return true;
-					}
+		if (!PON(obj->GetHandle()).IsInScene()) {
+			Log::For<Scene>().Error("The object for deletion was not found");
+			return false;
+		}
+
+		Delete(std::vector<PON>{ obj });
+		return true;
+	}
+	// Removes objects from their parents and from the object list
+	// in a single pass over each affected list.
+	static void Delete(const std::vector<PON>& objs) {
+		std::unordered_set<SceneObject*> deleted;
+		std::unordered_set<SceneObject*> parents;
+		for (auto& o : objs) {
+			if (!o.IsInScene())
+				continue;
+
+			auto parent = const_cast<SceneObject*>(o->GetParent());
+			if (!parent) {
+				Log::For<Scene>().Warning("You cannot delete root object");
+				continue;
+			}
+
+			parents.insert(parent);
+			o.SetInScene(false);
+			names().Remove(o->Name);
+			deleted.insert(o.Get());
+		}
+
+		if (deleted.empty())
+			return;
+
+		for (auto p : parents)
+			p->children.erase(
+				std::remove_if(p->children.begin(), p->children.end(), [&](SceneObject* c) { return deleted.count(c) > 0; }),
+				p->children.end());
+
+		SceneObject::HierarchyVersion()++;
 
-		Log::For<Scene>().Error("The object for deletion was not found");
-		return false;
+		auto& objects = Objects().Get();
+		objects.erase(
+			std::remove_if(objects.begin(), objects.end(), [](const PON& o) { return !o.IsInScene(); }),
+			objects.end());
 	}
 	void DeleteSelected() {
-		for (auto o : ObjectSelection::Selected()) {
+		std::vector<PON> objs;
+		for (auto& h : ObjectSelection::Selected()) {
+			PON o(h);
+			if (!o.HasValue())
+				continue;
+
 			o->Reset();
-			(new FuncCommand())->func = [this, o] {
-				Delete(const_cast<SceneObject*>(o.Get()->GetParent()), o.Get());
-			};
+			objs.push_back(o);
 		}
+
+		(new FuncCommand())->func = [objs] {
+			Delete(objs);
+		};
 	}
 	void DeleteAll() {
 		deleteAll().Invoke();
 		cross()->SetParent(nullptr);
 
+		for (auto& o : Objects().Get())
+			o.SetInScene(false);
+
 		Objects().Get().clear();
+		names().Clear();
 		root() = CreateRoot();
+		SceneObject::HierarchyVersion()++;
 	}
 
 	struct CategorizedObjects {
@@ -1032,38 +1541,17 @@ public:
 
 		return true;
 	}
-	static bool MoveTo(SceneObject* destination, int destinationPos, std::set<PON>* items, InsertPosition pos) {
+	static bool MoveTo(SceneObject* destination, int destinationPos, const std::set<ObjectHandle>* items, InsertPosition pos) {
 		std::set<SceneObject*> nitems;
-		for (auto o : *items)
-			nitems.emplace(o.Get());
+		for (auto& h : *items)
+			if (PON o(h); o.HasValue())
+				nitems.emplace(o.Get());
 
 		return MoveTo(destination, destinationPos, &nitems, pos);
 	}
 
 	static int GetNextDuplicateIndex(const std::string& originalName) {
-		std::string regex;
-		{
-			std::stringstream ss;
-			ss << originalName << " " << "(\\d+)";
-			regex = ss.str();
-		}
-		auto r = std::regex(regex);
-
-		int max = 0;
-		for (auto& o : Objects().Get()) {
-			std::smatch m;
-			if (!std::regex_search(o->Name, m, r))
-				continue;
-
-			std::stringstream ss;
-			ss << m[1];
-			int current;
-			ss >> current;
-			if (current > max)
-				max = current;
-		}
-
-		return max + 1;
+		return names().GetNextIndex(originalName);
 	}
 
 	static void AssignUniqueName(SceneObject* o, const std::string& originalName) {
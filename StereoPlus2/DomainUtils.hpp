@@ -2,6 +2,7 @@
 #include "SceneObject.hpp"
 #include <stack>
 #include <algorithm>
+#include <unordered_map>
 
 enum SelectPosition {
 	Anchor = 0x01,
@@ -10,7 +11,9 @@ enum SelectPosition {
 
 class ObjectSelection {
 public:
-	using Selection = std::set<PON>;
+	// Handles don't keep deleted objects alive
+	// and keep the order of selection stable between runs.
+	using Selection = std::set<ObjectHandle>;
 private:
 	static Selection& selected() {
 		static Selection v;
@@ -20,6 +23,24 @@ private:
 		static Event<const Selection&> v;
 		return v;
 	}
+
+	// Keeps the selection flags of the nodes in sync with the set.
+	// The selection doesn't own objects so only the ones
+	// that already have a node can be selected.
+	static void Emplace(SceneObject* o) {
+		if (!o)
+			return;
+
+		if (PON p(o->GetHandle()); p.HasValue() && p.Get() == o) {
+			selected().emplace(p.GetHandle());
+			p.SetSelected(true);
+		}
+	}
+	static void Clear() {
+		for (auto& h : selected())
+			PON(h).SetSelected(false);
+		selected().clear();
+	}
 public:
 	static IEvent<const Selection&>& OnChanged() {
 		return onChanged();
@@ -34,26 +55,29 @@ public:
 	}
 
 	static void Set(SceneObject* o) {
-		selected().clear();
-		selected().emplace(o);
+		Clear();
+		Emplace(o);
 		onChanged().Invoke(selected());
 	}
 	static void Set(const std::vector<SceneObject*>& os) {
-		selected().clear();
+		Clear();
 		for (auto o : os)
-			selected().emplace(o);
+			Emplace(o);
 		onChanged().Invoke(selected());
 	}
 	static void Add(SceneObject* o) {
-		selected().emplace(o);
+		Emplace(o);
 		onChanged().Invoke(selected());
 	}
 	static void RemoveAll() {
-		selected().clear();
+		Clear();
 		onChanged().Invoke(selected());
 	}
 	static void Remove(SceneObject* o) {
-		selected().erase(o);
+		if (auto v = selected().find(o->GetHandle()); v != selected().end()) {
+			PON(*v).SetSelected(false);
+			selected().erase(v);
+		}
 		onChanged().Invoke(selected());
 	}
 };
@@ -67,7 +91,7 @@ public:
 private:
 	struct State {
 		// Reference, Shallow copy
-		std::map<SceneObject*, SceneObject*> copies;
+		std::unordered_map<SceneObject*, SceneObject*> copies;
 
 		// Objects in their original order
 		std::vector<std::pair<SceneObject*, PON>> objects;
@@ -110,8 +134,9 @@ private:
 			current->copies[o.Get()] = o->Clone();
 		}
 
-		for (auto& o : ObjectSelection::Selected())
-			current->selection.push_back(o.Get());
+		for (auto& h : ObjectSelection::Selected())
+			if (PON o(h); o.HasValue())
+				current->selection.push_back(o.Get());
 	}
 
 	// Erase saved copies.
@@ -141,19 +166,22 @@ private:
 
 	static void Apply(std::vector<PON>& objects, int pos) {
 		// Saved state at position pos.
-		auto saved = at(pos);
+		auto& saved = at(pos);
 
 		// Delete current objects.
-		for (auto& o : objects)
+		for (auto& o : objects) {
+			o.SetInScene(false);
 			o.Delete();
+		}
 
-		std::map<SceneObject*, SceneObject*> newCopies;
+		std::unordered_map<SceneObject*, SceneObject*> newCopies;
 		for (auto [f,s] : saved.copies)
 			newCopies[f] = s->Clone();
 
 		objects.clear();
 		for (auto [a,b] : saved.objects) {
 			b.Set(newCopies[a]);
+			b.SetInScene(true);
 			objects.push_back(b);
 		}
 
@@ -176,6 +204,7 @@ private:
 			}));
 
 		RootObject() = newRoot;
+		SceneObject::HierarchyVersion()++;
 	}
 	static void ApplyPast(std::vector<PON>& objects) {
 		position()--;
@@ -248,7 +277,7 @@ public:
 
 class DragDropBuffer {
 public:
-	using Buffer = ObjectSelection::Selection*;
+	using Buffer = const ObjectSelection::Selection*;
 private:
 	static const ImGuiPayload* AcceptDragDropPayload(const char* name, ImGuiDragDropFlags flags) {
 		return ImGui::AcceptDragDropPayload(name, flags);
@@ -267,8 +296,9 @@ public:
 		if (const ImGuiPayload* payload = ImGui::AcceptDragDropPayload(name, flags)) {
 			auto objectPointers = GetBuffer(payload->Data);
 
-			for (auto objectPointer : *objectPointers)
-				outSceneObjects->push_back(objectPointer);
+			for (auto& h : *objectPointers)
+				if (PON o(h); o.HasValue())
+					outSceneObjects->push_back(o);
 
 			return true;
 		}
@@ -82,6 +82,17 @@ public:
 
 			break;
 		}
+		case GridMeshT:
+		{
+			auto o = (GridMesh*)&so;
+
+			put(o->GetColumns());
+			put(o->GetVertices().size());
+			for (auto p : o->GetVertices())
+				put(p);
+
+			break;
+		}
 		default:
 			throw std::exception("Unsupported Scene Object Type found while writing file.");
 		}
@@ -207,6 +218,17 @@ public:
 			readChildren(o);
 			return o;
 		}
+		case GridMeshT:
+		{
+			auto o = start<GridMesh>();
+			read(&o->Name);
+			read(std::function([&o](glm::vec3 v) { o->SetLocalPosition(v); }));
+			read(std::function([&o](glm::fquat v) { o->SetLocalRotation(v); }));
+			read(std::function([&o](size_t v) { o->SetColumns(v); }));
+			readArray(std::function([&o](glm::vec3 v) { o->AddVertice(v); }));
+			readChildren(o);
+			return o;
+		}
 		case TraceObjectT:
 		{
 			auto o = start<TraceObject>();
@@ -410,6 +432,17 @@ public:
 			getArray(j, "connections", std::function([&o](size_t a, size_t b) { o->Connect(a, b); }));
 			return o;
 		}
+		case GridMeshT:
+		{
+			auto o = start<GridMesh>();
+			get(j, "name", o->Name);
+			get(j, "localPosition", std::function([&o](glm::vec3 v) { o->SetLocalPosition(v); }));
+			get(j, "localRotation", std::function([&o](glm::fquat v) { o->SetLocalRotation(v); }));
+			getChildren(j, "children", o);
+			get(j, "columns", std::function([&o](size_t v) { o->SetColumns(v); }));
+			getArray(j, "vertices", std::function([&o](glm::vec3 v) { o->AddVertice(v); }));
+			return o;
+		}
 		case CameraT:
 			break;
 		case CrossT:
@@ -506,6 +539,13 @@ public:
 			insert(jo, "connections", o->GetLinearConnections());
 			break;
 		}
+		case GridMeshT:
+		{
+			auto o = (GridMesh*)&so;
+			insert(jo, "columns", o->GetColumns());
+			insert(jo, "vertices", o->GetVertices());
+			break;
+		}
 		}
 
 		return jo;
@@ -571,7 +611,7 @@ class FileManager {
 		for (auto o : JsonConvert::objects())
 			newObjects.push_back(o);
 
-		inScene->Objects() = newObjects;
+		inScene->SetObjects(newObjects);
 	}
 
 	static void SaveBinary(std::string filename, Scene* inScene) {
@@ -602,7 +642,7 @@ class FileManager {
 		for (auto o : str.objects)
 			newObjects.push_back(o);
 
-		inScene->Objects() = newObjects;
+		inScene->SetObjects(newObjects);
 
 		delete[] buffer;
 		file.close();
@@ -48,49 +48,316 @@ public:
 		return contents;
 	}
 
-	static GLuint CreateShaderProgram(const char* vertexShaderSource, const char* fragmentShaderSource)
+	// Logs have no length limit since compilers report every error of a shader.
+	static std::string GetShaderLog(GLuint shader)
 	{
-		const Log log = Log::For<GLLoader>();
+		GLint length = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+		std::string infoLog(length > 0 ? length : 0, '\0');
+		if (length > 0)
+			glGetShaderInfoLog(shader, length, NULL, &infoLog[0]);
 
-		int success;
-		char infoLog[512];
+		return infoLog;
+	}
+	static std::string GetProgramLog(GLuint program)
+	{
+		GLint length = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+		std::string infoLog(length > 0 ? length : 0, '\0');
+		if (length > 0)
+			glGetProgramInfoLog(program, length, NULL, &infoLog[0]);
 
-		GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-		glCompileShader(vertexShader);
-		glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-		if (!success)
+		return infoLog;
+	}
+
+	static const char* GetStageName(GLenum type)
+	{
+		switch (type)
 		{
-			glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-			log.Error("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" + std::string(infoLog));
+		case GL_VERTEX_SHADER:
+			return "VERTEX";
+		case GL_GEOMETRY_SHADER:
+			return "GEOMETRY";
+		case GL_FRAGMENT_SHADER:
+			return "FRAGMENT";
+		default:
+			return "UNKNOWN";
 		}
-		GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-		glCompileShader(fragmentShader);
-		// check for shader compile errors
-		glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+	}
+
+	// Returns 0 if the shader doesn't compile.
+	static GLuint CompileShader(GLenum type, const char* source, const std::string& name = "")
+	{
+		const Log log = Log::For<GLLoader>();
+
+		int success;
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 		if (!success)
 		{
-			glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-			log.Error("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" + std::string(infoLog));
+			log.Error("ERROR::SHADER::" + std::string(GetStageName(type)) + "::COMPILATION_FAILED " + name + "\n" + GetShaderLog(shader));
+			glDeleteShader(shader);
+			return 0;
 		}
-		// link shaders
-		GLuint shaderProgram = glCreateProgram();
-		glAttachShader(shaderProgram, vertexShader);
-		glAttachShader(shaderProgram, fragmentShader);
-		glLinkProgram(shaderProgram);
-		// check for linking errors
-		glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+
+		return shader;
+	}
+	// Shaders are detached and deleted whether the program links or not.
+	static bool LinkProgram(GLuint program, const std::vector<GLuint>& shaders, const std::string& name = "")
+	{
+		const Log log = Log::For<GLLoader>();
+
+		int success;
+		for (auto shader : shaders)
+			glAttachShader(program, shader);
+		glLinkProgram(program);
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
 		if (!success)
+			log.Error("ERROR::SHADER::PROGRAM::LINKING_FAILED " + name + "\n" + GetProgramLog(program));
+
+		for (auto shader : shaders)
 		{
-			glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-			log.Error("ERROR::SHADER::PROGRAM::LINKING_FAILED\n" + std::string(infoLog));
+			glDetachShader(program, shader);
+			glDeleteShader(shader);
 		}
-		glDeleteShader(vertexShader);
-		glDeleteShader(fragmentShader);
+
+		return success;
+	}
+
+	static GLuint CreateShaderProgram(const std::vector<std::pair<GLenum, const char*>>& stages)
+	{
+		std::vector<GLuint> shaders;
+		for (auto [type, source] : stages)
+			if (auto shader = CompileShader(type, source))
+				shaders.push_back(shader);
+
+		GLuint shaderProgram = glCreateProgram();
+		LinkProgram(shaderProgram, shaders);
 
 		return shaderProgram;
 	}
+	static GLuint CreateShaderProgram(const char* vertexShaderSource, const char* fragmentShaderSource)
+	{
+		return CreateShaderProgram({ { GL_VERTEX_SHADER, vertexShaderSource }, { GL_FRAGMENT_SHADER, fragmentShaderSource } });
+	}
+	static GLuint CreateShaderProgram(const char* vertexShaderSource, const char* geometryShaderSource, const char* fragmentShaderSource)
+	{
+		return CreateShaderProgram({
+			{ GL_VERTEX_SHADER, vertexShaderSource },
+			{ GL_GEOMETRY_SHADER, geometryShaderSource },
+			{ GL_FRAGMENT_SHADER, fragmentShaderSource } });
+	}
 };
 
 
+
+// Filters redundant state changes and counts GL calls of a frame.
+// Bindings are assumed to change only through this class
+// until Invalidate is called.
+class GLState {
+public:
+	struct Statistics {
+		// Calls passed to GL.
+		size_t calls = 0;
+		// Redundant calls filtered out.
+		size_t skippedCalls = 0;
+		size_t drawCalls = 0;
+		size_t bufferUploads = 0;
+		size_t bytesUploaded = 0;
+	};
+
+private:
+	static const GLuint Unknown = ~0u;
+
+	struct Bindings {
+		GLuint program = Unknown;
+		GLuint vertexArray = Unknown;
+		GLuint arrayBuffer = Unknown;
+
+		GLuint stencilMask = Unknown;
+		GLenum stencilFunc = Unknown;
+		GLint stencilRef = 0;
+		GLuint stencilFuncMask = Unknown;
+		GLenum stencilFail = Unknown;
+		GLenum stencilDepthFail = Unknown;
+		GLenum stencilPass = Unknown;
+	};
+
+	static Bindings& bindings() {
+		static Bindings v;
+		return v;
+	}
+	static std::map<std::pair<GLuint, std::string>, GLint>& uniformLocations() {
+		static std::map<std::pair<GLuint, std::string>, GLint> v;
+		return v;
+	}
+	static std::map<std::pair<GLuint, GLint>, std::array<float, 4>>& uniformValues() {
+		static std::map<std::pair<GLuint, GLint>, std::array<float, 4>> v;
+		return v;
+	}
+	static Statistics& frame() {
+		static Statistics v;
+		return v;
+	}
+	static Statistics& lastFrame() {
+		static Statistics v;
+		return v;
+	}
+
+	static bool shouldCall(bool isRedundant) {
+		if (isRedundant)
+			frame().skippedCalls++;
+		else
+			frame().calls++;
+
+		return !isRedundant;
+	}
+	static bool shouldSetUniform(GLuint program, GLint location, const std::array<float, 4>& value) {
+		auto key = std::make_pair(program, location);
+		if (auto i = uniformValues().find(key); shouldCall(i != uniformValues().end() && i->second == value)) {
+			uniformValues()[key] = value;
+			return true;
+		}
+		return false;
+	}
+
+public:
+	// Forgets bindings changed by code that doesn't use the cache, e.g. ImGui backend.
+	static void Invalidate() {
+		bindings() = Bindings();
+	}
+
+	static void UseProgram(GLuint v) {
+		if (shouldCall(bindings().program == v))
+			glUseProgram(bindings().program = v);
+	}
+	static void BindVertexArray(GLuint v) {
+		if (shouldCall(bindings().vertexArray == v))
+			glBindVertexArray(bindings().vertexArray = v);
+	}
+	// Element array binding is a part of the vertex array state so it isn't cached.
+	static void BindBuffer(GLenum target, GLuint v) {
+		if (target != GL_ARRAY_BUFFER) {
+			frame().calls++;
+			glBindBuffer(target, v);
+		}
+		else if (shouldCall(bindings().arrayBuffer == v))
+			glBindBuffer(target, bindings().arrayBuffer = v);
+	}
+	// Deleted names may be reused by GL so they are dropped from the cache.
+	// Program names are reused by the driver so cached uniforms must not outlive the program.
+	static void DeleteProgram(GLuint v) {
+		if (bindings().program == v)
+			bindings().program = Unknown;
+		for (auto i = uniformLocations().begin(); i != uniformLocations().end();)
+			i = i->first.first == v ? uniformLocations().erase(i) : std::next(i);
+		for (auto i = uniformValues().begin(); i != uniformValues().end();)
+			i = i->first.first == v ? uniformValues().erase(i) : std::next(i);
+		frame().calls++;
+		glDeleteProgram(v);
+	}
+	static void DeleteVertexArrays(GLsizei n, const GLuint* v) {
+		for (GLsizei i = 0; i < n; i++)
+			if (bindings().vertexArray == v[i])
+				bindings().vertexArray = Unknown;
+		frame().calls++;
+		glDeleteVertexArrays(n, v);
+	}
+	static void DeleteBuffers(GLsizei n, const GLuint* v) {
+		for (GLsizei i = 0; i < n; i++)
+			if (bindings().arrayBuffer == v[i])
+				bindings().arrayBuffer = Unknown;
+		frame().calls++;
+		glDeleteBuffers(n, v);
+	}
+	static void BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+		frame().calls++;
+		frame().bufferUploads++;
+		// Allocation without data doesn't transfer anything.
+		if (data)
+			frame().bytesUploaded += size;
+		glBufferData(target, size, data, usage);
+	}
+	static void BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+		frame().calls++;
+		frame().bufferUploads++;
+		frame().bytesUploaded += size;
+		glBufferSubData(target, offset, size, data);
+	}
+
+	static void StencilMask(GLuint v) {
+		if (shouldCall(bindings().stencilMask == v))
+			glStencilMask(bindings().stencilMask = v);
+	}
+	static void StencilFunc(GLenum func, GLint ref, GLuint mask) {
+		auto& b = bindings();
+		if (shouldCall(b.stencilFunc == func && b.stencilRef == ref && b.stencilFuncMask == mask))
+			glStencilFunc(b.stencilFunc = func, b.stencilRef = ref, b.stencilFuncMask = mask);
+	}
+	static void StencilOp(GLenum fail, GLenum depthFail, GLenum pass) {
+		auto& b = bindings();
+		if (shouldCall(b.stencilFail == fail && b.stencilDepthFail == depthFail && b.stencilPass == pass))
+			glStencilOp(b.stencilFail = fail, b.stencilDepthFail = depthFail, b.stencilPass = pass);
+	}
+
+	static GLint GetUniformLocation(GLuint program, const char* name) {
+		auto key = std::make_pair(program, std::string(name));
+		if (auto i = uniformLocations().find(key); i != uniformLocations().end())
+			return i->second;
+
+		frame().calls++;
+		return uniformLocations()[key] = glGetUniformLocation(program, name);
+	}
+	// Available since GL4.1
+	static void ProgramUniform1f(GLuint program, const char* name, float x) {
+		if (auto location = GetUniformLocation(program, name); shouldSetUniform(program, location, { x, 0, 0, 0 }))
+			glProgramUniform1f(program, location, x);
+	}
+	static void ProgramUniform1i(GLuint program, const char* name, GLint x) {
+		if (auto location = GetUniformLocation(program, name); shouldSetUniform(program, location, { (float)x, 0, 0, 0 }))
+			glProgramUniform1i(program, location, x);
+	}
+	static void ProgramUniform2f(GLuint program, const char* name, float x, float y) {
+		if (auto location = GetUniformLocation(program, name); shouldSetUniform(program, location, { x, y, 0, 0 }))
+			glProgramUniform2f(program, location, x, y);
+	}
+	static void ProgramUniform3f(GLuint program, const char* name, float x, float y, float z) {
+		if (auto location = GetUniformLocation(program, name); shouldSetUniform(program, location, { x, y, z, 0 }))
+			glProgramUniform3f(program, location, x, y, z);
+	}
+	static void ProgramUniform4f(GLuint program, const char* name, float x, float y, float z, float w) {
+		if (auto location = GetUniformLocation(program, name); shouldSetUniform(program, location, { x, y, z, w }))
+			glProgramUniform4f(program, location, x, y, z, w);
+	}
+
+	static void DrawArrays(GLenum mode, GLint first, GLsizei count) {
+		frame().calls++;
+		frame().drawCalls++;
+		glDrawArrays(mode, first, count);
+	}
+	static void DrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instanceCount) {
+		frame().calls++;
+		frame().drawCalls++;
+		glDrawArraysInstanced(mode, first, count, instanceCount);
+	}
+	static void DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+		frame().calls++;
+		frame().drawCalls++;
+		glDrawElements(mode, count, type, indices);
+	}
+
+	// Called once per displayed frame.
+	static void EndFrame() {
+		lastFrame() = frame();
+		frame() = Statistics();
+	}
+	static const Statistics& LastFrame() {
+		return lastFrame();
+	}
+	// Counters of the frame being rendered.
+	static const Statistics& CurrentFrame() {
+		return frame();
+	}
+};
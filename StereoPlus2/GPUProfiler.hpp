@@ -0,0 +1,226 @@
+#pragma once
+
+#include "GLLoader.hpp"
+#include "InfrastructureTypes.hpp"
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// Measures GPU time and GL statistics of named phases of a frame.
+// Phases nest, e.g. the render passes are measured inside the scene window.
+// Queries are read a few frames later when their results are available
+// so the CPU never waits for the GPU.
+class GPUProfiler {
+public:
+	struct Phase {
+		std::string name;
+		int depth;
+		double milliseconds = 0;
+		size_t drawCalls = 0;
+		size_t bufferUploads = 0;
+		size_t bytesUploaded = 0;
+	};
+	struct Frame {
+		size_t index;
+		// In the order the phases were first entered.
+		std::vector<Phase> phases;
+	};
+
+private:
+	struct Measurement {
+		size_t phase;
+		GLuint begin;
+		GLuint end;
+	};
+	// Phases entered more than once a frame, e.g. tiles of the advanced render,
+	// are summed up.
+	struct PendingFrame {
+		Frame frame;
+		std::vector<Measurement> measurements;
+	};
+	struct OpenPhase {
+		size_t measurement;
+		GLState::Statistics statistics;
+	};
+
+	// Frames of history kept for averages and the export.
+	static const size_t historyLength = 600;
+	static const GLsizei queryBatchSize = 32;
+
+	static std::vector<GLuint>& freeQueries() {
+		static std::vector<GLuint> v;
+		return v;
+	}
+	static PendingFrame& current() {
+		static PendingFrame v;
+		return v;
+	}
+	static std::vector<OpenPhase>& openPhases() {
+		static std::vector<OpenPhase> v;
+		return v;
+	}
+	static std::deque<PendingFrame>& pending() {
+		static std::deque<PendingFrame> v;
+		return v;
+	}
+	static std::deque<Frame>& history() {
+		static std::deque<Frame> v;
+		return v;
+	}
+	static size_t& frameIndex() {
+		static size_t v = 0;
+		return v;
+	}
+
+	static GLuint acquireQuery() {
+		if (freeQueries().empty()) {
+			freeQueries().resize(queryBatchSize);
+			glGenQueries(queryBatchSize, freeQueries().data());
+		}
+
+		auto query = freeQueries().back();
+		freeQueries().pop_back();
+		return query;
+	}
+
+	static size_t findPhase(const char* name, int depth) {
+		auto& phases = current().frame.phases;
+		for (size_t i = 0; i < phases.size(); i++)
+			if (phases[i].depth == depth && phases[i].name == name)
+				return i;
+
+		phases.push_back({ name, depth });
+		return phases.size() - 1;
+	}
+
+	// Returns false if the GPU hasn't reached the end of the frame yet.
+	static bool tryRead(PendingFrame& pendingFrame) {
+		if (!pendingFrame.measurements.empty()) {
+			GLint isAvailable = 0;
+			glGetQueryObjectiv(pendingFrame.measurements.back().end, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+			if (!isAvailable)
+				return false;
+		}
+
+		for (auto& m : pendingFrame.measurements) {
+			GLuint64 begin, end;
+			glGetQueryObjectui64v(m.begin, GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(m.end, GL_QUERY_RESULT, &end);
+			pendingFrame.frame.phases[m.phase].milliseconds += (end - begin) / 1e6;
+
+			freeQueries().push_back(m.begin);
+			freeQueries().push_back(m.end);
+		}
+
+		return true;
+	}
+
+public:
+	// Phases aren't measured while nothing shows them.
+	StaticFieldDefault(bool, IsEnabled, true)
+
+	// Phases must be ended in reverse order within the frame.
+	// Returns false if the phase wasn't opened, it must not be ended then.
+	static bool Begin(const char* name) {
+		if (!IsEnabled())
+			return false;
+
+		auto& frame = current();
+		frame.measurements.push_back({ findPhase(name, (int)openPhases().size()), acquireQuery(), 0 });
+		glQueryCounter(frame.measurements.back().begin, GL_TIMESTAMP);
+
+		openPhases().push_back({ frame.measurements.size() - 1, GLState::CurrentFrame() });
+		return true;
+	}
+	static void End() {
+		if (openPhases().empty())
+			return;
+
+		auto open = openPhases().back();
+		openPhases().pop_back();
+
+		auto& m = current().measurements[open.measurement];
+		m.end = acquireQuery();
+		glQueryCounter(m.end, GL_TIMESTAMP);
+
+		auto& statistics = GLState::CurrentFrame();
+		auto& phase = current().frame.phases[m.phase];
+		phase.drawCalls += statistics.drawCalls - open.statistics.drawCalls;
+		phase.bufferUploads += statistics.bufferUploads - open.statistics.bufferUploads;
+		phase.bytesUploaded += statistics.bytesUploaded - open.statistics.bytesUploaded;
+	}
+
+	// Measures the scope it is declared in.
+	// Profiling may be disabled within the scope so it ends only the phase it opened.
+	struct Scope {
+		bool isOpen;
+
+		Scope(const char* name) {
+			isOpen = Begin(name);
+		}
+		~Scope() {
+			if (isOpen)
+				End();
+		}
+	};
+
+	// Called once a frame after the buffers are swapped.
+	static void EndFrame() {
+		// A phase left open would never get its end query.
+		while (!openPhases().empty())
+			End();
+
+		current().frame.index = frameIndex()++;
+		if (!current().frame.phases.empty())
+			pending().push_back(std::move(current()));
+		current() = PendingFrame();
+
+		while (!pending().empty() && tryRead(pending().front())) {
+			history().push_back(std::move(pending().front().frame));
+			pending().pop_front();
+
+			if (history().size() > historyLength)
+				history().pop_front();
+		}
+	}
+
+	// The latest frame whose results are available.
+	static const Frame* LastFrame() {
+		return history().empty() ? nullptr : &history().back();
+	}
+	static const std::deque<Frame>& History() {
+		return history();
+	}
+	// Milliseconds of the outermost phases of the latest available frame.
+	static double GetFrameMilliseconds() {
+		double v = 0;
+		if (auto frame = LastFrame())
+			for (auto& phase : frame->phases)
+				if (phase.depth == 0)
+					v += phase.milliseconds;
+
+		return v;
+	}
+
+	// Writes the history as a table with a row per phase of a frame.
+	static bool Export(const std::string& path) {
+		std::ofstream out(path);
+		if (!out)
+			return false;
+
+		out << "frame,phase,depth,gpu ms,draws,uploads,bytes uploaded\n";
+		for (auto& frame : history())
+			for (auto& phase : frame.phases)
+				out << frame.index << ',' << phase.name << ',' << phase.depth << ','
+					<< phase.milliseconds << ',' << phase.drawCalls << ','
+					<< phase.bufferUploads << ',' << phase.bytesUploaded << '\n';
+
+		return out.good();
+	}
+
+	static void Clear() {
+		history().clear();
+	}
+};
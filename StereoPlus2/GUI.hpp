@@ -16,6 +16,40 @@ class GUI {
 
 	FileWindow* fileWindow = nullptr;
 
+	// Frames to produce after a change so ImGui can settle
+	// hover, layout and docking states.
+	static const int redrawFrameCount = 3;
+	// Seconds. Idle frames are still produced that often
+	// to pick up changes that weren't reported.
+	static constexpr double idleRedrawInterval = 1;
+
+	static std::atomic<int>& pendingFrames() {
+		static std::atomic<int> v = redrawFrameCount;
+		return v;
+	}
+
+	bool ShouldRedrawContinuously() {
+		return !Settings::ShouldRenderOnDemand().Get()
+			|| pendingFrames() > 0
+			|| Input::IsContinuousInputOneSecondDelay()
+			|| ImGui::IsAnyMouseDown();
+	}
+
+	// Blocks until an event arrives when there is nothing to redraw.
+	void WaitForChanges() {
+		if (ShouldRedrawContinuously()) {
+			glfwPollEvents();
+			return;
+		}
+
+		auto begin = std::chrono::steady_clock::now();
+		glfwWaitEventsTimeout(idleRedrawInterval);
+
+		// Woken before the timeout means input or a requested redraw.
+		if (std::chrono::steady_clock::now() - begin < std::chrono::duration<double>(idleRedrawInterval))
+			pendingFrames() = redrawFrameCount;
+	}
+
 	bool CreateFileWindow(FileWindow::Mode mode) {
 		auto fileWindow = new FileWindow();
 
@@ -62,6 +96,7 @@ class GUI {
 				ImGui::MenuItem(LocaleProvider::GetC("usePositionDetection"), nullptr, &h))
 				Settings::ShouldDetectPosition() = h;
 			ImGui::MenuItem(LocaleProvider::GetC("showFPS"), nullptr, &shouldShowFPS);
+			ImGui::MenuItem(LocaleProvider::GetC("showProfiler"), nullptr, &profilerWindow->IsOpen.Get());
 
 			if (ImGui::MenuItem(LocaleProvider::GetC("settings"), nullptr, false))
 				settingsWindow->IsOpen = true;
@@ -77,12 +112,17 @@ class GUI {
 				renderViewport();
 			if (ImGui::MenuItem(LocaleProvider::GetC("renderAdvanced"), "F6", false))
 				renderAdvanced();
+			if (ImGui::MenuItem(LocaleProvider::GetC("exportSequence"), nullptr, false))
+				exportSequence();
 
 			ImGui::EndMenu();
 		}
 
 		if (shouldShowFPS) {
-			ImGui::LabelText("", "FPS: %-12i DeltaTime: %-12f", Time::GetAverageFrameRate(), Time::GetAverageDeltaTime());
+			auto& gl = GLState::LastFrame();
+			ImGui::LabelText("", "FPS: %-12i DeltaTime: %-12f GPU ms: %-8.2f GL calls: %-8i skipped: %-8i draws: %-8i uploads: %-8i KB: %-8.1f",
+				Time::GetAverageFrameRate(), Time::GetAverageDeltaTime(), GPUProfiler::GetFrameMilliseconds(),
+				(int)gl.calls, (int)gl.skippedCalls, (int)gl.drawCalls, (int)gl.bufferUploads, gl.bytesUploaded / 1024.f);
 		}
 
 		return true;
@@ -149,6 +189,7 @@ public:
 	Scene* scene;
 
 	SettingsWindow* settingsWindow;
+	ProfilerWindow* profilerWindow;
 
 	bool shouldShowFPS = true;
 
@@ -156,11 +197,24 @@ public:
 	std::function<bool()> customRenderFunc;
 	std::function<void()> renderViewport;
 	std::function<void()> renderAdvanced;
+	std::function<void()> exportSequence;
+	// Seconds spent on a frame excluding waiting for events and vsync.
+	std::function<void(float)> onFrameRendered = [](float) {};
+
+	// Schedules frames and wakes the main loop if it waits for events.
+	// Can be called from any thread.
+	static void RequestRedraw() {
+		pendingFrames() = redrawFrameCount;
+		glfwPostEmptyEvent();
+	}
 
 	bool Init()
 	{
 		input.GLFWindow() = glWindow;
 
+		SceneObject::OnBeforeAnyElementChanged() += [] { RequestRedraw(); };
+		ObjectSelection::OnChanged() += [](const ObjectSelection::Selection&) { RequestRedraw(); };
+
 		
 		// Setup Dear ImGui context
 		IMGUI_CHECKVERSION();
@@ -262,7 +316,8 @@ public:
 			// - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application.
 			// - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application.
 			// Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
-			glfwPollEvents();
+			WaitForChanges();
+			auto frameBegin = std::chrono::steady_clock::now();
 			input.ProcessInput();
 
 			// Start the Dear ImGui frame
@@ -282,7 +337,9 @@ public:
 			glfwGetFramebufferSize(glWindow, &display_w, &display_h);
 			glViewport(0, 0, display_w, display_h);
 			glClear(GL_COLOR_BUFFER_BIT);
+			GPUProfiler::Begin("imgui");
 			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			GPUProfiler::End();
 
 			// Update and Render additional Platform Windows
 			// (Platform functions may change the current OpenGL context, so we save/restore it to make it easier to paste this code elsewhere.
@@ -294,11 +351,20 @@ public:
 				glfwMakeContextCurrent(backup_current_context);
 			}
 
+			onFrameRendered(std::chrono::duration<float>(std::chrono::steady_clock::now() - frameBegin).count());
+
 			glfwSwapBuffers(glWindow);
+			// Switched only between frames so phases are always ended.
+			GPUProfiler::IsEnabled() = shouldShowFPS || profilerWindow->IsOpen.Get();
+			GPUProfiler::EndFrame();
+			GLState::EndFrame();
 
 			if (!Command::ExecuteAll())
 				return false;
 
+			if (pendingFrames() > 0)
+				pendingFrames()--;
+
 			Time::UpdateFrame();
 			//std::cout << "FPS: " << Time::GetFrameRate() << std::endl;
 		}
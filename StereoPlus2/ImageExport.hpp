@@ -0,0 +1,575 @@
+#pragma once
+
+#include "GLLoader.hpp"
+#include "InfrastructureTypes.hpp"
+#include "include/stb/stb_image_write.h"
+#include <glm/vec2.hpp>
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+
+// Pixels read back from OpenGL. Rows are padded to 4 bytes.
+struct Image {
+	int width = 0;
+	int height = 0;
+	int channels = 3;
+	int stride = 0;
+	std::vector<char> pixels;
+
+	static int GetStride(int width, int channels) {
+		auto stride = channels * width;
+		return stride + ((stride % 4) ? (4 - stride % 4) : 0);
+	}
+};
+
+// Encodes images to files on worker threads.
+// Completion is reported through the Command queue so handlers run on the main thread.
+class ImageEncoder {
+	struct Job {
+		Image image;
+		std::string fileName;
+		std::function<void(bool)> onDone;
+	};
+
+	const Log log = Log::For<ImageEncoder>();
+
+	std::vector<std::thread> workers;
+	std::deque<Job> jobs;
+	std::mutex jobsLock;
+	std::condition_variable hasJobs;
+	bool mustStop = false;
+	size_t pendingJobs = 0;
+
+	void work() {
+		while (true) {
+			Job job;
+			{
+				std::unique_lock lock(jobsLock);
+				hasJobs.wait(lock, [&] { return mustStop || !jobs.empty(); });
+				if (jobs.empty())
+					return;
+
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+
+			auto isSaved = stbi_write_png(job.fileName.c_str(), job.image.width, job.image.height, job.image.channels, job.image.pixels.data(), job.image.stride) != 0;
+
+			Command::Post([this, isSaved, fileName = job.fileName, onDone = job.onDone] {
+				pendingJobs--;
+
+				if (isSaved)
+					log.Information("Image saved to ", fileName);
+				else
+					log.Error("Failed to save image to ", fileName);
+
+				onDone(isSaved);
+			});
+		}
+	}
+
+public:
+	// Leaves one core for rendering and one for tracking.
+	static unsigned GetDefaultWorkerCount() {
+		auto n = std::thread::hardware_concurrency();
+		return n > 2 ? n - 2 : 1;
+	}
+
+	ImageEncoder(unsigned workerCount = GetDefaultWorkerCount()) {
+		for (unsigned i = 0; i < workerCount; i++)
+			workers.push_back(std::thread([&] { work(); }));
+	}
+
+	// Must be called from the main thread.
+	void Encode(Image&& image, const std::string& fileName, const std::function<void(bool)>& onDone = [](bool) {}) {
+		pendingJobs++;
+		{
+			std::lock_guard lock(jobsLock);
+			jobs.push_back({ std::move(image), fileName, onDone });
+		}
+		hasJobs.notify_one();
+	}
+
+	// Images queued or being encoded whose completion wasn't reported yet.
+	size_t GetPendingCount() const {
+		return pendingJobs;
+	}
+
+	// Finishes queued jobs before returning.
+	~ImageEncoder() {
+		{
+			std::lock_guard lock(jobsLock);
+			mustStop = true;
+		}
+		hasJobs.notify_all();
+
+		for (auto& w : workers)
+			w.join();
+	}
+};
+
+// Reads framebuffer pixels into pixel buffer objects without stalling the pipeline.
+// The buffers are mapped once their fences are signaled, usually a frame or two later.
+// Buffers are reused and new ones are created when all are in flight,
+// so requests are never dropped.
+class PixelReadbackQueue {
+	struct Request {
+		GLuint buffer;
+		GLsync fence;
+		int width;
+		int height;
+		std::function<void(Image&&)> onRead;
+	};
+
+	std::vector<GLuint> freeBuffers;
+	std::deque<Request> requests;
+
+	GLuint takeBuffer(GLsizeiptr size) {
+		GLuint buffer;
+		if (freeBuffers.empty())
+			glGenBuffers(1, &buffer);
+		else {
+			buffer = freeBuffers.back();
+			freeBuffers.pop_back();
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+		return buffer;
+	}
+
+	void complete(Request& request) {
+		Image image;
+		image.width = request.width;
+		image.height = request.height;
+		image.stride = Image::GetStride(image.width, image.channels);
+		image.pixels.resize((size_t)image.stride * image.height);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, request.buffer);
+		if (auto data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, image.pixels.size(), GL_MAP_READ_BIT)) {
+			memcpy(image.pixels.data(), data, image.pixels.size());
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		glDeleteSync(request.fence);
+		freeBuffers.push_back(request.buffer);
+
+		request.onRead(std::move(image));
+	}
+
+public:
+	// Starts reading the color attachment of the framebuffer.
+	// onRead is called from Poll when the pixels are available.
+	void Read(GLuint framebuffer, int width, int height, const std::function<void(Image&&)>& onRead) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glReadBuffer(framebuffer == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+		auto buffer = takeBuffer((GLsizeiptr)Image::GetStride(width, 3) * height);
+		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		requests.push_back({ buffer, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), width, height, onRead });
+	}
+
+	// Completes the requests whose pixels already arrived. Call once per frame.
+	// When wait is set blocks until all requests are completed.
+	void Poll(bool wait = false) {
+		while (!requests.empty()) {
+			auto& request = requests.front();
+
+			auto status = glClientWaitSync(request.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+			if (status == GL_TIMEOUT_EXPIRED)
+				return;
+
+			auto r = request;
+			requests.pop_front();
+			complete(r);
+		}
+	}
+
+	size_t GetPendingCount() const {
+		return requests.size();
+	}
+
+	// Releases OpenGL objects. Must be called while the context is alive.
+	void Clear() {
+		for (auto& r : requests) {
+			glDeleteSync(r.fence);
+			freeBuffers.push_back(r.buffer);
+		}
+		requests.clear();
+
+		if (!freeBuffers.empty())
+			glDeleteBuffers((GLsizei)freeBuffers.size(), freeBuffers.data());
+		freeBuffers.clear();
+	}
+};
+
+// Writes an image of known size row band by row band
+// so the whole image never has to be in memory.
+class StripedImageWriter {
+public:
+	// Rows are RGB, 3 bytes per pixel.
+	virtual bool Open(const std::string& fileName, int width, int height) = 0;
+	// Appends rows in the order they are stored in the file.
+	// Rows start stride bytes apart.
+	virtual bool Write(const char* rows, int rowCount, int stride) = 0;
+	virtual bool Close() = 0;
+
+	virtual ~StripedImageWriter() {}
+};
+
+// Uncompressed baseline TIFF with a strip per row.
+// Strip offsets are known in advance so rows are written as they come.
+class TiffImageWriter : public StripedImageWriter {
+	std::ofstream file;
+	int width = 0;
+
+	void writeShort(uint16_t v) {
+		file.write((const char*)&v, sizeof(v));
+	}
+	void writeLong(uint32_t v) {
+		file.write((const char*)&v, sizeof(v));
+	}
+	void writeEntry(uint16_t tag, uint16_t type, uint32_t count, uint32_t value) {
+		writeShort(tag);
+		writeShort(type);
+		writeLong(count);
+		// Short values are left-justified in the value field.
+		if (type == 3 && count == 1) {
+			writeShort((uint16_t)value);
+			writeShort(0);
+		}
+		else
+			writeLong(value);
+	}
+
+public:
+	virtual bool Open(const std::string& fileName, int width, int height) override {
+		const uint16_t shortType = 3, longType = 4, entryCount = 10;
+		uint64_t rowSize = (uint64_t)width * 3;
+
+		const uint32_t ifdOffset = 8;
+		const uint32_t bitsPerSampleOffset = ifdOffset + 2 + entryCount * 12 + 4;
+		const uint32_t stripOffsetsOffset = bitsPerSampleOffset + 3 * 2;
+		const uint32_t stripByteCountsOffset = stripOffsetsOffset + height * 4;
+		const uint32_t dataOffset = stripByteCountsOffset + height * 4;
+
+		// Classic TIFF offsets are 32 bit.
+		if (dataOffset + rowSize * height > UINT32_MAX)
+			return false;
+
+		file.open(fileName, std::ios::binary);
+		if (!file)
+			return false;
+
+		this->width = width;
+
+		file.write("II*\0", 4);
+		writeLong(ifdOffset);
+
+		writeShort(entryCount);
+		writeEntry(256, longType, 1, width);
+		writeEntry(257, longType, 1, height);
+		writeEntry(258, shortType, 3, bitsPerSampleOffset);
+		// No compression.
+		writeEntry(259, shortType, 1, 1);
+		// RGB
+		writeEntry(262, shortType, 1, 2);
+		writeEntry(273, longType, height, stripOffsetsOffset);
+		writeEntry(277, shortType, 1, 3);
+		writeEntry(278, longType, 1, 1);
+		writeEntry(279, longType, height, stripByteCountsOffset);
+		// Chunky
+		writeEntry(284, shortType, 1, 1);
+		writeLong(0);
+
+		for (int i = 0; i < 3; i++)
+			writeShort(8);
+		for (int i = 0; i < height; i++)
+			writeLong((uint32_t)(dataOffset + rowSize * i));
+		for (int i = 0; i < height; i++)
+			writeLong((uint32_t)rowSize);
+
+		return (bool)file;
+	}
+	virtual bool Write(const char* rows, int rowCount, int stride) override {
+		for (int i = 0; i < rowCount; i++)
+			file.write(rows + (size_t)i * stride, (size_t)width * 3);
+
+		return (bool)file;
+	}
+	virtual bool Close() override {
+		file.close();
+		return !file.fail();
+	}
+};
+
+// PNG whose image data is stored in uncompressed deflate blocks.
+// Compression would need the whole zlib stream at once,
+// stored blocks let every row band be written as a separate IDAT chunk.
+class PngImageWriter : public StripedImageWriter {
+	std::ofstream file;
+	int width = 0;
+	uint32_t adlerA = 1, adlerB = 0;
+	std::vector<char> chunk;
+
+	static const std::array<uint32_t, 256>& crcTable() {
+		static std::array<uint32_t, 256> v = [] {
+			std::array<uint32_t, 256> t;
+			for (uint32_t n = 0; n < 256; n++) {
+				auto c = n;
+				for (int k = 0; k < 8; k++)
+					c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				t[n] = c;
+			}
+			return t;
+		}();
+		return v;
+	}
+
+	static void appendBigEndian(std::vector<char>& v, uint32_t x) {
+		for (int i = 3; i >= 0; i--)
+			v.push_back((char)((x >> (i * 8)) & 0xff));
+	}
+
+	void updateAdler(const char* data, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			adlerA = (adlerA + (unsigned char)data[i]) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+		}
+	}
+
+	// Appends stored deflate blocks holding the data.
+	void appendStored(const char* data, size_t size) {
+		const size_t maxBlock = 65535;
+		for (size_t offset = 0; offset < size; offset += maxBlock) {
+			auto length = (uint16_t)(size - offset < maxBlock ? size - offset : maxBlock);
+			chunk.push_back(0);
+			chunk.push_back((char)(length & 0xff));
+			chunk.push_back((char)(length >> 8));
+			chunk.push_back((char)(~length & 0xff));
+			chunk.push_back((char)((uint16_t)~length >> 8));
+			chunk.insert(chunk.end(), data + offset, data + offset + length);
+		}
+	}
+
+	bool writeChunk(const char* type, const std::vector<char>& data) {
+		std::vector<char> header;
+		appendBigEndian(header, (uint32_t)data.size());
+		file.write(header.data(), header.size());
+
+		uint32_t crc = 0xffffffffu;
+		auto update = [&](const char* p, size_t n) {
+			for (size_t i = 0; i < n; i++)
+				crc = crcTable()[(crc ^ (unsigned char)p[i]) & 0xff] ^ (crc >> 8);
+		};
+		update(type, 4);
+		update(data.data(), data.size());
+
+		file.write(type, 4);
+		file.write(data.data(), data.size());
+
+		std::vector<char> footer;
+		appendBigEndian(footer, crc ^ 0xffffffffu);
+		file.write(footer.data(), footer.size());
+
+		return (bool)file;
+	}
+
+public:
+	virtual bool Open(const std::string& fileName, int width, int height) override {
+		file.open(fileName, std::ios::binary);
+		if (!file)
+			return false;
+
+		this->width = width;
+		adlerA = 1;
+		adlerB = 0;
+
+		file.write("\x89PNG\r\n\x1a\n", 8);
+
+		std::vector<char> header;
+		appendBigEndian(header, width);
+		appendBigEndian(header, height);
+		// 8 bit RGB, deflate, adaptive filtering, no interlace.
+		header.insert(header.end(), { 8, 2, 0, 0, 0 });
+		if (!writeChunk("IHDR", header))
+			return false;
+
+		// zlib header: deflate with 32K window, no preset dictionary.
+		return writeChunk("IDAT", { 0x78, 0x01 });
+	}
+	virtual bool Write(const char* rows, int rowCount, int stride) override {
+		std::vector<char> raw;
+		raw.reserve((size_t)rowCount * (width * 3 + 1));
+		for (int i = 0; i < rowCount; i++) {
+			// Filter type None.
+			raw.push_back(0);
+			raw.insert(raw.end(), rows + (size_t)i * stride, rows + (size_t)i * stride + (size_t)width * 3);
+		}
+		updateAdler(raw.data(), raw.size());
+
+		chunk.clear();
+		appendStored(raw.data(), raw.size());
+		return writeChunk("IDAT", chunk);
+	}
+	virtual bool Close() override {
+		// Empty final block and the checksum of the uncompressed data.
+		chunk = { 1, 0, 0, (char)0xff, (char)0xff };
+		appendBigEndian(chunk, (adlerB << 16) | adlerA);
+
+		auto isWritten = writeChunk("IDAT", chunk) && writeChunk("IEND", {});
+		file.close();
+		return isWritten && !file.fail();
+	}
+};
+
+// Color and depth-stencil renderbuffers for rendering outside of the scene window.
+struct OffscreenFramebuffer {
+	GLuint fbo = 0;
+	GLuint colorBuffer = 0;
+	GLuint depthBuffer = 0;
+	glm::ivec2 size;
+
+	bool Create(const glm::ivec2& size) {
+		this->size = size;
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+		glGenRenderbuffers(1, &colorBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.x, size.y);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+
+		glGenRenderbuffers(1, &depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size.x, size.y);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		auto isComplete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		return isComplete;
+	}
+
+	void Delete() {
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteRenderbuffers(1, &colorBuffer);
+		glDeleteRenderbuffers(1, &depthBuffer);
+		fbo = colorBuffer = depthBuffer = 0;
+	}
+};
+
+// Camera positions over time linearly interpolated between keyframes.
+// Uses the trajectory format of position detection: "seconds,horizontal,vertical,distance" per line,
+// so both hand made paths and recorded head trajectories can be used.
+class CameraPath {
+	struct Keyframe {
+		double time;
+		glm::vec3 position;
+	};
+	std::vector<Keyframe> keyframes;
+
+public:
+	bool Load(const std::string& fileName) {
+		std::ifstream file(fileName);
+		if (!file.is_open())
+			return false;
+
+		keyframes.clear();
+
+		std::string line;
+		while (std::getline(file, line)) {
+			std::replace(line.begin(), line.end(), ',', ' ');
+			std::stringstream ss(line);
+
+			Keyframe k;
+			if (ss >> k.time >> k.position.x >> k.position.y >> k.position.z)
+				keyframes.push_back(k);
+		}
+
+		std::stable_sort(keyframes.begin(), keyframes.end(), [](const Keyframe& a, const Keyframe& b) { return a.time < b.time; });
+		return !keyframes.empty();
+	}
+
+	// Seconds from the first keyframe to the last one.
+	double GetDuration() const {
+		return keyframes.empty() ? 0 : keyframes.back().time - keyframes.front().time;
+	}
+
+	// Time is relative to the first keyframe.
+	glm::vec3 At(double time) const {
+		time += keyframes.front().time;
+
+		auto next = std::upper_bound(keyframes.begin(), keyframes.end(), time, [](double t, const Keyframe& k) { return t < k.time; });
+		if (next == keyframes.begin())
+			return next->position;
+		if (next == keyframes.end())
+			return keyframes.back().position;
+
+		auto& previous = *(next - 1);
+		auto t = (float)((time - previous.time) / (next->time - previous.time));
+		return previous.position + (next->position - previous.position) * t;
+	}
+};
+
+// Streams raw RGB frames to a local ffmpeg process which encodes a video.
+// ffmpeg must be available in PATH.
+class VideoPipeWriter {
+	FILE* pipe = nullptr;
+	int width = 0;
+
+public:
+	bool Open(const std::string& fileName, int width, int height, int frameRate) {
+		this->width = width;
+
+		std::stringstream ss;
+		ss << "ffmpeg -y -loglevel error -f rawvideo -pix_fmt rgb24"
+			<< " -s " << width << "x" << height
+			<< " -r " << frameRate
+			<< " -i - -vf pad=ceil(iw/2)*2:ceil(ih/2)*2 -pix_fmt yuv420p \"" << fileName << "\"";
+
+#ifdef _WIN32
+		pipe = _popen(ss.str().c_str(), "wb");
+#else
+		pipe = popen(ss.str().c_str(), "w");
+#endif
+		return pipe != nullptr;
+	}
+
+	// Must be called in frame order.
+	bool Write(const Image& image) {
+		for (int row = 0; row < image.height; row++)
+			if (fwrite(image.pixels.data() + (size_t)row * image.stride, 1, (size_t)width * 3, pipe) != (size_t)width * 3)
+				return false;
+
+		return true;
+	}
+
+	// Waits for ffmpeg to finish encoding.
+	bool Close() {
+		if (!pipe)
+			return false;
+
+#ifdef _WIN32
+		auto result = _pclose(pipe);
+#else
+		auto result = pclose(pipe);
+#endif
+		pipe = nullptr;
+		return result == 0;
+	}
+};
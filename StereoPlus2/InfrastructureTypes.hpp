@@ -10,6 +10,10 @@
 #include <set>
 #include <functional>
 #include <map>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <glm/vec3.hpp>
 
 #include <fstream>
@@ -319,6 +323,14 @@ class Command {
 		static auto queue = std::list<Command*>();
 		return queue;
 	}
+	static std::vector<std::function<void()>>& GetPosted() {
+		static std::vector<std::function<void()>> v;
+		return v;
+	}
+	static std::mutex& GetPostedLock() {
+		static std::mutex v;
+		return v;
+	}
 protected:
 	bool isReady = false;
 	virtual bool Execute() = 0;
@@ -326,7 +338,22 @@ public:
 	Command() {
 		GetQueue().push_back(this);
 	}
+	// Can be called from any thread.
+	// The function is executed by the main loop along with commands.
+	static void Post(const std::function<void()>& func) {
+		std::lock_guard lock(GetPostedLock());
+		GetPosted().push_back(func);
+	}
+
 	static bool ExecuteAll() {
+		std::vector<std::function<void()>> posted;
+		{
+			std::lock_guard lock(GetPostedLock());
+			posted.swap(GetPosted());
+		}
+		for (auto& func : posted)
+			func();
+
 		std::list<Command*> deleteQueue;
 		for (auto command : GetQueue())
 			if (command->isReady) {
@@ -757,6 +784,125 @@ public:
 
 
 
+// Fixed-size buffer that keeps the last Capacity pushed values.
+template<typename T, size_t Capacity>
+class RingBuffer {
+	std::array<T, Capacity> items;
+	size_t first = 0;
+	size_t size = 0;
+public:
+	void Push(const T& v) {
+		if (size < Capacity) {
+			items[(first + size++) % Capacity] = v;
+			return;
+		}
+
+		items[first] = v;
+		first = (first + 1) % Capacity;
+	}
+	void Clear() {
+		first = size = 0;
+	}
+	size_t Size() const {
+		return size;
+	}
+	bool IsEmpty() const {
+		return size == 0;
+	}
+	// 0 is the oldest value.
+	const T& At(size_t i) const {
+		return items[(first + i) % Capacity];
+	}
+	const T& Last() const {
+		return At(size - 1);
+	}
+};
+
+// Bounded lock-free queue for a single producer and a single consumer thread.
+template<typename T, size_t Capacity>
+class SpscQueue {
+	std::array<T, Capacity + 1> items;
+	std::atomic<size_t> head = 0;
+	std::atomic<size_t> tail = 0;
+
+	static size_t Next(size_t i) {
+		return (i + 1) % (Capacity + 1);
+	}
+public:
+	// Fails when the queue is full.
+	bool TryPush(const T& v) {
+		auto t = tail.load(std::memory_order_relaxed);
+		auto next = Next(t);
+		if (next == head.load(std::memory_order_acquire))
+			return false;
+
+		items[t] = v;
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+	// Fails when the queue is empty.
+	bool TryPop(T& v) {
+		auto h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+
+		v = std::move(items[h]);
+		head.store(Next(h), std::memory_order_release);
+		return true;
+	}
+};
+
+// Lock-free single value exchange between a writer and a reader thread.
+// The reader always gets the latest written value, older ones are dropped.
+template<typename T>
+class TripleBuffer {
+	static const int dirtyBit = 0x4;
+	static const int indexMask = 0x3;
+
+	std::array<T, 3> buffers;
+	// Index of the buffer shared between the writer and the reader
+	// plus the bit telling that it holds a value the reader hasn't seen.
+	std::atomic<int> middle = 1;
+	int back = 0;
+	int front = 2;
+public:
+	void Write(const T& v) {
+		buffers[back] = v;
+		back = middle.exchange(back | dirtyBit, std::memory_order_acq_rel) & indexMask;
+	}
+	// Returns false when no new value was written since the last read.
+	bool Read(T& v) {
+		if ((middle.load(std::memory_order_relaxed) & dirtyBit) == 0)
+			return false;
+
+		front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+		v = buffers[front];
+		return true;
+	}
+};
+
+// Lets a consumer thread sleep until a producer has new data for it.
+// A signal sent before Wait isn't lost, Wait returns at once then.
+class WakeEvent {
+	std::mutex lock;
+	std::condition_variable condition;
+	bool isSignaled = false;
+public:
+	void Signal() {
+		{
+			std::lock_guard l(lock);
+			isSignaled = true;
+		}
+		condition.notify_one();
+	}
+	void Wait() {
+		std::unique_lock l(lock);
+		condition.wait(l, [&] { return isSignaled; });
+		isSignaled = false;
+	}
+};
+
+
 #define StaticProperty(type,name)\
 static Property<type>& name() {\
 	static Property<type> v = Property<type>();\
@@ -403,17 +403,23 @@ class KeyBinding {
 			if (Input::IsPressed(Key::Modifier::Alt)) {
 				if (Input::IsDown(Key::N5, true) && !ObjectSelection::Selected().empty()) {
 					glm::vec3 v(0);
-					for (auto& o : ObjectSelection::Selected())
-						v += o.Get()->GetWorldPosition();
-					v /= ObjectSelection::Selected().size();
-					Scene::cross()->SetWorldPosition(v);
+					int count = 0;
+					for (auto& h : ObjectSelection::Selected())
+						if (PON o(h); o.HasValue()) {
+							v += o->GetWorldPosition();
+							count++;
+						}
+					if (count > 0)
+						Scene::cross()->SetWorldPosition(v / (float)count);
 				}
 				else if (Input::IsDown(Key::N0, true))
 					Scene::cross()->SetWorldPosition(glm::vec3());
 			}
 			else if (Input::IsPressed(Key::Modifier::Control)) {
-				if (Input::IsDown(Key::N5, true) && !ObjectSelection::Selected().empty())
-					Scene::cross()->SetWorldRotation(ObjectSelection::Selected().begin()._Ptr->_Myval->GetWorldRotation());
+				if (Input::IsDown(Key::N5, true) && !ObjectSelection::Selected().empty()) {
+					if (PON o(*ObjectSelection::Selected().begin()); o.HasValue())
+						Scene::cross()->SetWorldRotation(o->GetWorldRotation());
+				}
 				else if (Input::IsDown(Key::N0, true))
 					Scene::cross()->SetWorldRotation(glm::quat(1, 0, 0, 0));
 			}
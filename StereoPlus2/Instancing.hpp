@@ -0,0 +1,165 @@
+#pragma once
+
+#include "SceneObject.hpp"
+#include <glm/mat4x4.hpp>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+// Objects with the same local vertices, e.g. clones of a trace,
+// drawn with one vertex upload and one draw call per eye.
+// World transforms are taken per instance from a buffer
+// and vertices are projected by shaders/Instanced.vert.
+class InstancedObjects {
+	struct Group {
+		// Its vertices are shared by the group.
+		const SceneObject* source;
+		size_t hash;
+		std::vector<glm::mat4> transforms;
+	};
+
+	// Reused by groups in order so buffers aren't recreated when objects are regrouped.
+	struct Buffers {
+		GLuint VAO = 0;
+		GLuint geometryVBO = 0;
+		GLuint instanceVBO = 0;
+		// Hash of the uploaded vertices, the geometry isn't uploaded again while it matches.
+		size_t hash = 0;
+		GLsizei vertexCount = 0;
+		// Uploaded transforms.
+		std::vector<glm::mat4> transforms;
+
+		void Create() {
+			glGenVertexArrays(1, &VAO);
+			glGenBuffers(1, &geometryVBO);
+			glGenBuffers(1, &instanceVBO);
+
+			GLState::BindVertexArray(VAO);
+
+			GLState::BindBuffer(GL_ARRAY_BUFFER, geometryVBO);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+			glEnableVertexAttribArray(0);
+
+			// A matrix attribute takes a location per column.
+			GLState::BindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+			for (GLuint i = 0; i < 4; i++) {
+				glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * i));
+				glEnableVertexAttribArray(1 + i);
+				glVertexAttribDivisor(1 + i, 1);
+			}
+
+			GLState::BindVertexArray(0);
+		}
+	};
+
+	std::vector<SceneObject*> objects;
+	std::vector<Group> groups;
+	std::vector<Buffers> buffers;
+	bool shouldRegroup = true;
+
+	static size_t getHash(const std::vector<glm::vec3>& vertices) {
+		return std::hash<std::string_view>()(std::string_view((const char*)vertices.data(), sizeof(glm::vec3) * vertices.size()));
+	}
+
+	void regroup() {
+		groups.clear();
+
+		// Hash -> indices of groups with vertices of the hash.
+		std::unordered_map<size_t, std::vector<size_t>> groupsByHash;
+		for (auto o : objects) {
+			auto& vertices = o->GetVertices();
+			auto hash = getHash(vertices);
+
+			auto& candidates = groupsByHash[hash];
+			auto group = std::find_if(candidates.begin(), candidates.end(), [&](size_t i) {
+				return groups[i].source->GetVertices() == vertices;
+				});
+
+			if (group == candidates.end()) {
+				candidates.push_back(groups.size());
+				groups.push_back({ o, hash });
+				groups.back().transforms.push_back(o->GetWorldTransform());
+			}
+			else
+				groups[*group].transforms.push_back(o->GetWorldTransform());
+		}
+	}
+
+	void upload() {
+		while (buffers.size() < groups.size()) {
+			buffers.push_back(Buffers());
+			buffers.back().Create();
+		}
+
+		for (size_t i = 0; i < groups.size(); i++) {
+			auto& group = groups[i];
+			auto& buffer = buffers[i];
+			auto& vertices = group.source->GetVertices();
+
+			if (buffer.hash != group.hash || buffer.vertexCount != (GLsizei)vertices.size()) {
+				GLState::BindBuffer(GL_ARRAY_BUFFER, buffer.geometryVBO);
+				GLState::BufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+				buffer.hash = group.hash;
+				buffer.vertexCount = (GLsizei)vertices.size();
+			}
+
+			if (buffer.transforms != group.transforms) {
+				GLState::BindBuffer(GL_ARRAY_BUFFER, buffer.instanceVBO);
+				GLState::BufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * group.transforms.size(), group.transforms.data(), GL_DYNAMIC_DRAW);
+				buffer.transforms = std::move(group.transforms);
+			}
+		}
+	}
+
+public:
+	// Moves objects that can be drawn as instances out of the list.
+	void Take(std::vector<SceneObject*>& list) {
+		objects.clear();
+
+		auto rest = list.begin();
+		for (auto o : list)
+			if (o->IsInstanceable())
+				objects.push_back(o);
+			else
+				*rest++ = o;
+		list.erase(rest, list.end());
+
+		shouldRegroup = true;
+	}
+
+	bool IsEmpty() const {
+		return objects.empty();
+	}
+
+	// Regroups objects when any of them changed.
+	// Camera changes mark every object as changed, but the camera is a uniform of the shader
+	// so only the buffers that differ from the uploaded ones are uploaded.
+	void Update() {
+		bool isChanged = shouldRegroup;
+		for (auto o : objects)
+			if (o->MarkInstanceUpdated())
+				isChanged = true;
+
+		if (!isChanged)
+			return;
+
+		shouldRegroup = false;
+		regroup();
+		upload();
+	}
+
+	// Eyes differ only by the program.
+	void Draw(GLuint program) const {
+		for (size_t i = 0; i < groups.size(); i++) {
+			auto& buffer = buffers[i];
+			if (buffer.vertexCount < 2)
+				continue;
+
+			GLState::BindVertexArray(buffer.VAO);
+			GLState::UseProgram(program);
+			GLState::DrawArraysInstanced(GL_LINE_STRIP, 0, buffer.vertexCount, (GLsizei)buffer.transforms.size());
+		}
+	}
+};
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "InfrastructureTypes.hpp"
+#include "Settings.hpp"
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <cfloat>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Simplified copies of a polyline in its local space built on a background thread.
+// Objects are only moved and rotated so the levels stay valid whatever the transform is.
+// Levels are used only until the vertices are edited, which is reported with Invalidate,
+// so an edited line is drawn at full resolution until its new chain is ready.
+class LevelOfDetail {
+public:
+	struct Level {
+		// Millimeters. Maximum distance of the simplified line from the original.
+		float tolerance;
+		std::vector<glm::vec3> vertices;
+	};
+
+private:
+	struct Chain {
+		// Version of the vertices the chain was built from.
+		size_t version;
+		std::vector<Level> levels;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	// Accessed only from the main thread.
+	struct State {
+		bool isAlive = true;
+		bool isBuilding = false;
+		std::shared_ptr<const Chain> chain;
+		std::function<void()> onBuilt;
+	};
+
+	// Builds chains one by one so simplification never competes with rendering for more than one core.
+	class Builder {
+		std::thread worker;
+		std::deque<std::function<void()>> jobs;
+		std::mutex jobsLock;
+		std::condition_variable hasJobs;
+		bool mustStop = false;
+
+		void work() {
+			while (true) {
+				std::function<void()> job;
+				{
+					std::unique_lock lock(jobsLock);
+					hasJobs.wait(lock, [&] { return mustStop || !jobs.empty(); });
+					if (mustStop)
+						return;
+
+					job = std::move(jobs.front());
+					jobs.pop_front();
+				}
+				job();
+			}
+		}
+
+	public:
+		Builder() {
+			worker = std::thread([&] { work(); });
+		}
+
+		void Add(std::function<void()>&& job) {
+			{
+				std::lock_guard lock(jobsLock);
+				jobs.push_back(std::move(job));
+			}
+			hasJobs.notify_one();
+		}
+
+		// Queued jobs are dropped since nothing is going to draw them.
+		~Builder() {
+			{
+				std::lock_guard lock(jobsLock);
+				mustStop = true;
+			}
+			hasJobs.notify_all();
+			worker.join();
+		}
+	};
+
+	static Builder& builder() {
+		static Builder v;
+		return v;
+	}
+
+	// Lines shorter than this are cheaper to draw than to select a level for.
+	static const size_t minVertexCount = 64;
+	static const size_t maxLevelCount = 12;
+	static constexpr float baseTolerance = 0.05f;
+	// A coarser level is taken only when its error is below this part of the allowed error.
+	// Keeps the level from flickering when the allowed error is close to a level's tolerance.
+	static constexpr float hysteresis = 0.5f;
+
+	std::shared_ptr<State> state = std::make_shared<State>();
+	// 0 is the original line, i is levels[i - 1].
+	size_t level = 0;
+	// Incremented on every edit of the vertices.
+	size_t version = 0;
+
+	static float distanceToSegment(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b) {
+		auto ab = b - a;
+		auto lengthSquared = glm::dot(ab, ab);
+		auto t = lengthSquared > 0 ? glm::dot(p - a, ab) / lengthSquared : 0.f;
+		t = t < 0 ? 0 : t > 1 ? 1 : t;
+		return glm::length(p - (a + ab * t));
+	}
+
+	static std::shared_ptr<const Chain> build(const std::vector<glm::vec3>& source, size_t version) {
+		auto chain = std::make_shared<Chain>();
+		chain->version = version;
+
+		chain->boundsMin = chain->boundsMax = source.front();
+		for (auto& v : source) {
+			chain->boundsMin = glm::min(chain->boundsMin, v);
+			chain->boundsMax = glm::max(chain->boundsMax, v);
+		}
+
+		auto previousSize = source.size();
+		auto tolerance = baseTolerance;
+		for (size_t i = 0; i < maxLevelCount && previousSize > 2; i++, tolerance *= 2) {
+			auto vertices = Simplify(source, tolerance);
+
+			// Levels that barely reduce the line aren't worth switching to.
+			if (vertices.size() * 4 > previousSize * 3)
+				continue;
+
+			previousSize = vertices.size();
+			chain->levels.push_back({ tolerance, std::move(vertices) });
+		}
+
+		return chain;
+	}
+
+	void requestBuild(const std::vector<glm::vec3>& vertices) {
+		if (state->isBuilding)
+			return;
+		state->isBuilding = true;
+
+		builder().Add([state = state, source = vertices, version = version] {
+			auto chain = build(source, version);
+
+			Command::Post([state, chain] {
+				if (!state->isAlive)
+					return;
+
+				state->isBuilding = false;
+				state->chain = chain;
+				if (state->onBuilt)
+					state->onBuilt();
+			});
+
+			// The main loop may be waiting for events.
+			if (OnAnyBuilt())
+				OnAnyBuilt()();
+		});
+	}
+
+	bool fits(size_t i, float allowedTolerance) const {
+		return i == 0 || state->chain->levels[i - 1].tolerance <= allowedTolerance;
+	}
+
+public:
+	// Pixels per view coordinate unit of the render target, set by the renderer.
+	StaticFieldDefault(glm::vec2, PixelsPerViewUnit, glm::vec2(1))
+	// Called from the builder thread when any chain is ready.
+	StaticField(std::function<void()>, OnAnyBuilt)
+
+	LevelOfDetail() {}
+	// Chains belong to the vertices of one object and are never shared.
+	LevelOfDetail(const LevelOfDetail&) : LevelOfDetail() {}
+	// Assigning means the vertices of the object were replaced.
+	LevelOfDetail& operator=(const LevelOfDetail&) {
+		Invalidate();
+		return *this;
+	}
+	~LevelOfDetail() {
+		state->isAlive = false;
+	}
+
+	// Must be called on every edit of the vertices.
+	// A transform of the object doesn't invalidate its levels.
+	void Invalidate() {
+		version++;
+	}
+
+	// Called on the main thread when a new chain can be selected from.
+	void SetOnBuilt(const std::function<void()>& onBuilt) {
+		state->onBuilt = onBuilt;
+	}
+
+	// Douglas-Peucker simplification.
+	static std::vector<glm::vec3> Simplify(const std::vector<glm::vec3>& points, float tolerance) {
+		if (points.size() < 3)
+			return points;
+
+		std::vector<bool> shouldKeep(points.size(), false);
+		shouldKeep.front() = shouldKeep.back() = true;
+
+		std::vector<std::pair<size_t, size_t>> ranges = { { 0, points.size() - 1 } };
+		while (!ranges.empty()) {
+			auto [first, last] = ranges.back();
+			ranges.pop_back();
+
+			float maxDistance = 0;
+			size_t farthest = first;
+			for (size_t i = first + 1; i < last; i++)
+				if (auto d = distanceToSegment(points[i], points[first], points[last]); d > maxDistance) {
+					maxDistance = d;
+					farthest = i;
+				}
+
+			if (maxDistance > tolerance) {
+				shouldKeep[farthest] = true;
+				ranges.push_back({ first, farthest });
+				ranges.push_back({ farthest, last });
+			}
+		}
+
+		std::vector<glm::vec3> result;
+		for (size_t i = 0; i < points.size(); i++)
+			if (shouldKeep[i])
+				result.push_back(points[i]);
+
+		return result;
+	}
+
+	// Returns the coarsest level whose error is below Settings::LevelOfDetailError pixels
+	// on the projection of the line's bounds.
+	// Vertices and the returned level are in local space, toWorld maps them to world units.
+	const std::vector<glm::vec3>& Select(const std::vector<glm::vec3>& vertices, const glm::mat4& toWorld, const std::function<glm::vec3(glm::vec3)>& project) {
+		auto maxError = Settings::LevelOfDetailError().Get();
+		if (maxError <= 0 || vertices.size() < minVertexCount) {
+			level = 0;
+			return vertices;
+		}
+
+		if (!state->chain || state->chain->version != version) {
+			requestBuild(vertices);
+			level = 0;
+			return vertices;
+		}
+
+		auto& chain = *state->chain;
+		if (chain.levels.empty())
+			return vertices;
+
+		glm::vec2 projectedMin(FLT_MAX), projectedMax(-FLT_MAX);
+		for (int i = 0; i < 8; i++) {
+			auto corner = glm::vec3(
+				i & 1 ? chain.boundsMax.x : chain.boundsMin.x,
+				i & 2 ? chain.boundsMax.y : chain.boundsMin.y,
+				i & 4 ? chain.boundsMax.z : chain.boundsMin.z);
+			auto p = glm::vec2(project(glm::vec3(toWorld * glm::vec4(corner, 1)))) * PixelsPerViewUnit();
+			projectedMin = glm::min(projectedMin, p);
+			projectedMax = glm::max(projectedMax, p);
+		}
+
+		auto worldExtent = glm::length(chain.boundsMax - chain.boundsMin);
+		auto screenExtent = glm::length(projectedMax - projectedMin);
+		auto allowedTolerance = screenExtent > 0 ? maxError * worldExtent / screenExtent : FLT_MAX;
+
+		if (level > chain.levels.size())
+			level = chain.levels.size();
+
+		while (level > 0 && !fits(level, allowedTolerance))
+			level--;
+		while (level < chain.levels.size() && fits(level + 1, allowedTolerance * hysteresis))
+			level++;
+
+		return level == 0 ? vertices : chain.levels[level - 1].vertices;
+	}
+};
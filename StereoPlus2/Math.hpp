@@ -255,6 +255,21 @@ public:
 		return getRight(v, cameraPos, eyeToCenterDistance, viewSize, viewSizeZ);
 	}
 
+	// Scale (xy) and offset (zw) applied to view coordinates by the vertex shader.
+	// Identity unless a tile of a larger image is rendered.
+	StaticFieldDefault(glm::vec4, TileTransform, glm::vec4(1, 1, 0, 0))
+
+	// Maps view coordinates of a view of viewSize pixels to a tile of an image of outputSize pixels
+	// as if the image was rendered in one piece with the same pixels per millimeter.
+	// View coordinates are inversely proportional to the view size
+	// so projected vertices don't need to be recalculated.
+	// Tile position is the pixel of its lower left corner.
+	static glm::vec4 GetTileTransform(const glm::vec2& viewSize, const glm::vec2& outputSize, const glm::vec2& tilePosition, const glm::vec2& tileSize) {
+		auto scale = viewSize / tileSize;
+		auto offset = (outputSize - tilePosition * 2.f - tileSize) / tileSize;
+		return glm::vec4(scale, offset);
+	}
+
 };
 
 class Build {
@@ -4,92 +4,573 @@
 #include "opencv2/highgui.hpp"
 #include "opencv2/imgproc.hpp"
 #include "opencv2/videoio.hpp"
+#include "opencv2/dnn.hpp"
 #include <iostream>
 #include "include/glm/glm.hpp"
 #include <queue>
 #include <future>
+#include <thread>
+#include <memory>
+#include <array>
+#include <algorithm>
+#include <fstream>
 #include "InfrastructureTypes.hpp"
 
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
 using namespace std;
 using namespace cv;
 
-class PositionDetector {
-    struct less_than_keyX {
-        inline bool operator() (const glm::vec2& a, const glm::vec2& b) {
-            return a.x < b.x;
-        }
-    };
-    struct less_than_keyY {
-        inline bool operator() (const glm::vec2& a, const glm::vec2& b) {
-            return a.y < b.y;
+// Smooths raw head positions.
+// Positions are in millimeters: horizontal, vertical, distance.
+class PositionFilter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    virtual void Reset() = 0;
+    // Adds a measurement taken at the given time and returns the filtered position.
+    virtual glm::vec3 Filter(const glm::vec3& v, Clock::time_point time) = 0;
+    // Filtered position extrapolated to the given time.
+    virtual glm::vec3 Predict(Clock::time_point time) const = 0;
+    // Estimated velocity in millimeters per second.
+    virtual glm::vec3 GetVelocity() const = 0;
+
+    virtual ~PositionFilter() {}
+};
+
+// Median of the horizontal and vertical position and average distance
+// over the last WindowSize measurements. Lags about half of the window.
+template<size_t WindowSize>
+class WindowPositionFilter : public PositionFilter {
+    RingBuffer<glm::vec3, WindowSize> window;
+    glm::vec3 value;
+
+    float median(int component) const {
+        std::array<float, WindowSize> values;
+        for (size_t i = 0; i < window.Size(); i++)
+            values[i] = window.At(i)[component];
+
+        auto middle = values.begin() + window.Size() / 2;
+        std::nth_element(values.begin(), middle, values.begin() + window.Size());
+        return *middle;
+    }
+    float average(int component) const {
+        float sum = 0;
+        for (size_t i = 0; i < window.Size(); i++)
+            sum += window.At(i)[component];
+
+        return sum / window.Size();
+    }
+public:
+    virtual void Reset() override {
+        window.Clear();
+    }
+    virtual glm::vec3 Filter(const glm::vec3& v, Clock::time_point time) override {
+        window.Push(v);
+        return value = glm::vec3(median(0), median(1), average(2));
+    }
+    virtual glm::vec3 Predict(Clock::time_point time) const override {
+        return value;
+    }
+    virtual glm::vec3 GetVelocity() const override {
+        return glm::vec3();
+    }
+};
+
+// One Euro filter with constant velocity prediction.
+// Smooths strongly when the head is still and follows closely when it moves.
+class OneEuroPositionFilter : public PositionFilter {
+    const float pi = 3.1415926f;
+
+    bool hasValue = false;
+    glm::vec3 value;
+    glm::vec3 velocity;
+    Clock::time_point lastTime;
+
+    float alpha(float cutoff, float dt) const {
+        auto tau = 1 / (2 * pi * cutoff);
+        return 1 / (1 + tau / dt);
+    }
+public:
+    // Hz
+    float minCutoff = 1;
+    float derivativeCutoff = 1;
+    // Cutoff increase per millimeter per second of speed.
+    float beta = 0.01;
+
+    virtual void Reset() override {
+        hasValue = false;
+    }
+    virtual glm::vec3 Filter(const glm::vec3& v, Clock::time_point time) override {
+        if (!hasValue) {
+            hasValue = true;
+            value = v;
+            velocity = glm::vec3();
+            lastTime = time;
+            return value;
         }
-    };
 
-    const Log log = Log::For<PositionDetector>();
+        auto dt = std::chrono::duration<float>(time - lastTime).count();
+        if (dt <= 0)
+            return value;
+        lastTime = time;
 
+        velocity += alpha(derivativeCutoff, dt) * ((v - value) / dt - velocity);
+
+        for (int i = 0; i < 3; i++)
+            value[i] += alpha(minCutoff + beta * std::abs(velocity[i]), dt) * (v[i] - value[i]);
+
+        return value;
+    }
+    virtual glm::vec3 Predict(Clock::time_point time) const override {
+        if (!hasValue)
+            return value;
+
+        return value + velocity * std::chrono::duration<float>(time - lastTime).count();
+    }
+    virtual glm::vec3 GetVelocity() const override {
+        return velocity;
+    }
+};
+
+// Head position at capture time with its velocity.
+// Lets the reader extrapolate the position to any moment.
+struct HeadPose {
+    glm::vec3 position = glm::vec3();
+    glm::vec3 velocity = glm::vec3();
+    PositionFilter::Clock::time_point captured;
+    // Millimeters. 0 when eyes weren't detected.
+    float eyeToCenterDistance = 0;
+
+    glm::vec3 At(PositionFilter::Clock::time_point time, std::chrono::milliseconds maxExtrapolation) const {
+        auto dt = std::min(std::chrono::duration<float>(time - captured).count(), std::chrono::duration<float>(maxExtrapolation).count());
+        return position + velocity * dt;
+    }
+};
+
+// A sample produced by a tracking source.
+// Image sources fill the image, trajectory sources fill the position.
+struct TrackingSample {
+    Mat image;
+    bool hasPosition = false;
+    glm::vec3 position;
+    PositionFilter::Clock::time_point captured;
+};
+
+// Input of the position detector.
+class TrackingSource {
+public:
+    virtual bool Open() = 0;
+    // Returns false when the source is exhausted or failed.
+    virtual bool Read(TrackingSample& sample) = 0;
+    // Sources of images need face detection, the others provide positions.
+    virtual bool ProducesFrames() const {
+        return true;
+    }
+
+    virtual ~TrackingSource() {}
+};
+
+class CameraSource : public TrackingSource {
     VideoCapture capture;
-    CascadeClassifier face_cascade;
-    CascadeClassifier eyes_cascade;
-    
-    int windowSize = 10;
-    std::list<float> distanceLeftEye, distanceRightEye;
-    std::list<glm::vec2> positionLeftEye, positionRightEye;
+public:
+    int device = 0;
 
-    std::atomic<bool> mustStopPositionProcessing;
-    std::thread distanceProcessThread;
+    virtual bool Open() override {
+        return capture.open(device);
+    }
+    virtual bool Read(TrackingSample& sample) override {
+        if (!capture.read(sample.image))
+            return false;
 
+        sample.captured = PositionFilter::Clock::now();
+        return true;
+    }
+};
 
-    std::list<float> faceSize;
-    std::list<glm::vec2> facePosition;
-    std::list<float> distanceToCameraBuffer;
+// Video file or image sequence (e.g. "frames/%04d.png").
+class VideoSource : public TrackingSource {
+    VideoCapture capture;
+    PositionFilter::Clock::time_point start;
+    double framePeriod = 0;
+    int frameIndex = 0;
+public:
+    std::string path;
+    // Play at the recorded frame rate instead of as fast as possible.
+    bool isRealTime = true;
 
+    VideoSource(const std::string& path) : path(path) {}
 
-    float avg(std::list<float> q) {
-        float sum = 0;
-        for (auto i : q)
-            sum += i;
+    virtual bool Open() override {
+        if (!capture.open(path))
+            return false;
 
-        return sum / q.size();
+        auto fps = capture.get(CAP_PROP_FPS);
+        framePeriod = fps > 0 ? 1 / fps : 0;
+        frameIndex = 0;
+        start = PositionFilter::Clock::now();
+        return true;
     }
+    virtual bool Read(TrackingSample& sample) override {
+        if (!capture.read(sample.image))
+            return false;
 
-    template<typename T>
-    const T& at(const std::list<T>& q, int pos) {
-        auto i = q.cbegin();
+        auto frameTime = start + std::chrono::duration_cast<PositionFilter::Clock::duration>(std::chrono::duration<double>(framePeriod * frameIndex++));
+        if (isRealTime)
+            std::this_thread::sleep_until(frameTime);
 
-        while (pos-- > 0) i++;
+        sample.captured = isRealTime ? frameTime : PositionFilter::Clock::now();
+        return true;
+    }
+};
+
+// Recorded head positions.
+// Each line of the file is "seconds,horizontal,vertical,distance"
+// optionally followed by the measured position before filtering.
+// Measured positions are replayed when present so a recording made by PositionRecorder
+// goes through the filter and prediction once, as in the original run.
+class TrajectorySource : public TrackingSource {
+    std::ifstream file;
+    PositionFilter::Clock::time_point start;
+public:
+    std::string path;
 
-        return i._Ptr->_Myval;
+    TrajectorySource(const std::string& path) : path(path) {}
+
+    virtual bool ProducesFrames() const override {
+        return false;
+    }
+    virtual bool Open() override {
+        file.open(path);
+        start = PositionFilter::Clock::now();
+        return file.is_open();
     }
+    virtual bool Read(TrackingSample& sample) override {
+        std::string line;
+        while (std::getline(file, line)) {
+            std::replace(line.begin(), line.end(), ',', ' ');
+            std::stringstream ss(line);
 
-    float medX(std::list<glm::vec2> q) {
-        q.sort(less_than_keyX());
-        return at(q, q.size() / 2).x;
+            double time;
+            glm::vec3 v, measured;
+            if (!(ss >> time >> v.x >> v.y >> v.z))
+                continue;
+            if (ss >> measured.x >> measured.y >> measured.z)
+                v = measured;
+
+            sample.hasPosition = true;
+            sample.position = v;
+            sample.captured = start + std::chrono::duration_cast<PositionFilter::Clock::duration>(std::chrono::duration<double>(time));
+            std::this_thread::sleep_until(sample.captured);
+            return true;
+        }
+
+        return false;
     }
-    float medY(std::list<glm::vec2> q) {
-        q.sort(less_than_keyY());
-        return at(q, q.size() / 2).y;
+};
+
+// Writes published positions followed by the measured ones in the format read by TrajectorySource.
+// The published columns alone are a camera path for the sequence export.
+class PositionRecorder {
+    std::ofstream file;
+    PositionFilter::Clock::time_point start;
+public:
+    bool Open(const std::string& path) {
+        file.open(path);
+        start = PositionFilter::Clock::now();
+        return file.is_open();
+    }
+    void Close() {
+        file.close();
+    }
+    bool IsOpen() const {
+        return file.is_open();
+    }
+    void Write(PositionFilter::Clock::time_point time, const glm::vec3& v, const glm::vec3& measured) {
+        file << std::chrono::duration<double>(time - start).count()
+            << ',' << v.x << ',' << v.y << ',' << v.z
+            << ',' << measured.x << ',' << measured.y << ',' << measured.z << '\n';
     }
+};
 
+// Searches faces on a BGR image.
+class FaceDetector {
+public:
+    virtual bool Init() = 0;
+    // Empty sizes don't limit the face size.
+    virtual void Detect(const Mat& image, std::vector<Rect>& faces, Size minSize = Size(), Size maxSize = Size()) = 0;
 
-    float getPosX(float center, const std::list<glm::vec2>& q, float distance) {
-        auto pixelToAngle = divide(cameraResolution, cameraViewAngle);
-        auto angleFaceSize = (center - medX(q)) / pixelToAngle.x;
-        auto posX = distance * tan(angleFaceSize * degreeToRadian);
-        return posX;
+    virtual ~FaceDetector() {}
+};
+
+// Haar or LBP cascade depending on the file.
+class CascadeFaceDetector : public FaceDetector {
+    CascadeClassifier cascade;
+public:
+    std::string fileName;
+
+    CascadeFaceDetector(const std::string& fileName) : fileName(fileName) {}
+
+    virtual bool Init() override {
+        auto path = samples::findFile(fileName, false);
+        return !path.empty() && cascade.load(path);
     }
-    float getPosY(float center, const std::list<glm::vec2>& q, float distance) {
-        auto pixelToAngle = divide(cameraResolution, cameraViewAngle);
-        auto angleFaceSize = (center - medY(q)) / pixelToAngle.x;
-        auto posX = distance * tan(angleFaceSize * degreeToRadian);
-        return posX;
+    virtual void Detect(const Mat& image, std::vector<Rect>& faces, Size minSize, Size maxSize) override {
+        Mat gray;
+        cvtColor(image, gray, COLOR_BGR2GRAY);
+        equalizeHist(gray, gray);
+
+        cascade.detectMultiScale(gray, faces, 1.1, 3, 0, minSize, maxSize);
+    }
+};
+
+// Res10 SSD face detector run by cv::dnn on CPU.
+class DnnFaceDetector : public FaceDetector {
+    dnn::Net net;
+public:
+    std::string configFileName = "dnn/deploy.prototxt";
+    std::string modelFileName = "dnn/res10_300x300_ssd_iter_140000.caffemodel";
+    float confidenceThreshold = 0.5;
+
+    virtual bool Init() override {
+        auto config = samples::findFile(configFileName, false);
+        auto model = samples::findFile(modelFileName, false);
+        if (config.empty() || model.empty())
+            return false;
+
+        try {
+            net = dnn::readNetFromCaffe(config, model);
+        }
+        catch (const cv::Exception&) {
+            return false;
+        }
+
+        net.setPreferableBackend(dnn::DNN_BACKEND_OPENCV);
+        net.setPreferableTarget(dnn::DNN_TARGET_CPU);
+        return !net.empty();
+    }
+    virtual void Detect(const Mat& image, std::vector<Rect>& faces, Size minSize, Size maxSize) override {
+        net.setInput(dnn::blobFromImage(image, 1, Size(300, 300), Scalar(104, 177, 123)));
+        auto output = net.forward();
+
+        // Rows of [image id, class, confidence, left, top, right, bottom].
+        Mat rows(output.size[2], output.size[3], CV_32F, output.ptr<float>());
+
+        faces.clear();
+        for (int i = 0; i < rows.rows; i++) {
+            if (rows.at<float>(i, 2) < confidenceThreshold)
+                continue;
+
+            auto face = Rect(
+                Point(rows.at<float>(i, 3) * image.cols, rows.at<float>(i, 4) * image.rows),
+                Point(rows.at<float>(i, 5) * image.cols, rows.at<float>(i, 6) * image.rows))
+                & Rect(Point(), image.size());
+
+            if (face.width < minSize.width || face.height < minSize.height
+                || maxSize.width > 0 && face.width > maxSize.width
+                || maxSize.height > 0 && face.height > maxSize.height)
+                continue;
+
+            faces.push_back(face);
+        }
+    }
+};
+
+// Keeps tracking threads and the render thread on different cores.
+class ThreadAffinity {
+public:
+    // The render thread keeps the first core, tracking uses the rest.
+    static bool CanSeparate() {
+        return std::thread::hardware_concurrency() > 1;
+    }
+
+    // Pins the calling thread to cores [first, first + count).
+    // Returns false when the OS doesn't allow it.
+    static bool PinCurrentThread(unsigned first, unsigned count) {
+#ifdef _WIN32
+        unsigned long long mask = 0;
+        for (auto i = first; i < first + count && i < 64; i++)
+            mask |= 1ull << i;
+
+        return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) != 0;
+#else
+        return false;
+#endif
+    }
+    static bool PinRenderThread() {
+        return CanSeparate() && PinCurrentThread(0, 1);
+    }
+    static bool PinTrackingThread() {
+        return CanSeparate() && PinCurrentThread(1, std::thread::hardware_concurrency() - 1);
+    }
+    // Lets the calling thread run on any core.
+    static bool UnpinCurrentThread() {
+        return PinCurrentThread(0, std::thread::hardware_concurrency());
+    }
+};
+
+enum class TrackerRatePolicy {
+    // Every captured frame is processed at full resolution.
+    Maximum,
+    // Quality is lowered while rendering or tracking runs out of its budget.
+    Adaptive,
+};
+
+// Chooses detection frequency, downscale factor and region of interest size
+// from the measured render frame time and tracker latency.
+// Quality is lowered when either budget is exceeded and restored step by step
+// when both have enough headroom.
+class TrackerRateController {
+public:
+    struct Level {
+        // Every n-th captured frame is processed.
+        int detectionInterval;
+        // Frame scale before detection.
+        float downscale;
+        // Multiplier of the region of interest scale.
+        float regionOfInterestFactor;
+    };
+
+private:
+    static const std::vector<Level>& levels() {
+        static std::vector<Level> v = {
+            { 1, 1, 1 },
+            { 1, 0.75, 1 },
+            { 2, 0.75, 0.875 },
+            { 2, 0.5, 0.75 },
+            { 3, 0.5, 0.75 },
+            { 4, 0.5, 0.75 },
+        };
+        return v;
     }
 
-    float getPosY(float center, const std::list<glm::vec2>& q) {
-        float d = center - medY(q);
+    std::atomic<size_t> level = 0;
+    // Seconds. Written by the render loop.
+    std::atomic<float> renderTime = 0;
+    // Seconds. Smoothed.
+    float latency = 0;
+    int detectionsSinceChange = 0;
+
+public:
+    TrackerRatePolicy policy = TrackerRatePolicy::Adaptive;
+    // Seconds
+    float frameBudget = 1 / 60.f;
+    float latencyBudget = 0.04;
+    // Loads below this part of the budgets let the quality recover.
+    float recoveryLoad = 0.6;
+    // Detections between level changes. Avoids oscillation.
+    int settleDetections = 15;
+    // Weight of a new latency measurement.
+    float latencySmoothing = 0.1;
+
+    void Reset() {
+        level = 0;
+        latency = 0;
+        detectionsSinceChange = 0;
+    }
 
-        return d;
+    // Time the render loop spent on the last frame excluding waiting.
+    // Can be called from any thread.
+    void ReportRenderTime(float seconds) {
+        renderTime = seconds;
     }
 
+    // Time between capturing a frame and finishing its detection.
+    // Must be called from the detection thread.
+    void ReportLatency(float seconds) {
+        latency = latency == 0 ? seconds : latency + latencySmoothing * (seconds - latency);
+
+        if (policy != TrackerRatePolicy::Adaptive || ++detectionsSinceChange < settleDetections)
+            return;
+
+        auto renderLoad = renderTime / frameBudget;
+        auto latencyLoad = latency / latencyBudget;
+
+        if ((renderLoad > 1 || latencyLoad > 1) && level + 1 < levels().size())
+            level++;
+        else if (renderLoad < recoveryLoad && latencyLoad < recoveryLoad && level > 0)
+            level--;
+        else
+            return;
+
+        detectionsSinceChange = 0;
+        Log::For<TrackerRateController>().Information(
+            "Tracker level: ", level.load(),
+            " render load: ", renderLoad,
+            " latency load: ", latencyLoad);
+    }
+
+    const Level& Get() const {
+        return policy == TrackerRatePolicy::Adaptive ? levels()[level] : levels()[0];
+    }
+    size_t GetLevel() const {
+        return level;
+    }
+
+    static const char* GetPolicyName(TrackerRatePolicy policy) {
+        switch (policy) {
+        case TrackerRatePolicy::Maximum: return "maximum";
+        default: return "adaptive";
+        }
+    }
+    static TrackerRatePolicy ParsePolicy(const std::string& name) {
+        return name == GetPolicyName(TrackerRatePolicy::Maximum)
+            ? TrackerRatePolicy::Maximum
+            : TrackerRatePolicy::Adaptive;
+    }
+};
+
+enum class FaceDetectorBackend {
+    Haar,
+    Lbp,
+    Dnn,
+};
+
+class PositionDetector {
+    const Log log = Log::For<PositionDetector>();
+
+    std::unique_ptr<FaceDetector> faceDetector;
+    CascadeClassifier eyes_cascade;
+    // Smoothed distance from the eyes to the center between them.
+    // Millimeters. 0 until eyes are found.
+    float eyeToCenterDistance = 0;
+
+    bool isInitialized = false;
+    std::atomic<bool> mustStopPositionProcessing;
+    std::thread distanceProcessThread;
+
+    std::atomic<bool> isBenchmarkRunning = false;
+    std::atomic<bool> mustStopBenchmark = false;
+    std::thread benchmarkThread;
+
+    // Tracking runs as a pipeline of capture, detection and filtering stages
+    // so a new frame is grabbed while the previous one is being processed.
+    struct Detection {
+        Rect face;
+        Size frameSize;
+        PositionFilter::Clock::time_point captured;
+        // Set when the source provides positions instead of images.
+        bool hasPosition;
+        glm::vec3 position;
+        // Distance between eye centers. 0 when eyes weren't found.
+        float eyeDistancePixels;
+    };
+    // Capture -> detection. Keeps only the newest frame.
+    TripleBuffer<TrackingSample> capturedFrames;
+    // Detection -> filtering.
+    SpscQueue<Detection, 16> detections;
+    std::thread detectionThread;
+    std::thread filterThread;
+    // Wake idle stages when their input arrives or processing stops.
+    WakeEvent hasCapturedFrame;
+    WakeEvent hasDetection;
+
+
     glm::vec2 divide(const glm::vec2& v1, const glm::vec2& v2) {
         return glm::vec2(v1.x / v2.x, v1.y / v2.y);
     }
@@ -97,86 +578,284 @@ class PositionDetector {
         return glm::vec2(v1.x * v2.x, v1.y * v2.y);
     }
 
-    float getDistanceToCamera(const std::list<float>& pixelFaceSizesY) {
+    float getDistanceToCamera(float pixelFaceSizeY) {
         auto pixelToAngle = divide(cameraResolution, cameraViewAngle);
-        auto angleFaceSize = avg(pixelFaceSizesY) / pixelToAngle.y;
+        auto angleFaceSize = pixelFaceSizeY / pixelToAngle.y;
         auto distance = faceSizeRealY / (tan(angleFaceSize / 2.f * degreeToRadian) * 2.f);
         return distance;
     }
 
-    void detectAndDisplay(Mat frame)
+    // Track state of the region of interest mode.
+    bool hasTrackedFace = false;
+    Rect trackedFace, previousTrackedFace;
+    int framesSinceFullDetection = 0;
+
+    void track(const std::vector<Rect>& faces) {
+        hasTrackedFace = !faces.empty();
+        if (!hasTrackedFace)
+            return;
+
+        // The largest face belongs to the closest viewer.
+        auto largest = std::max_element(faces.begin(), faces.end(), [](const Rect& a, const Rect& b) { return a.area() < b.area(); });
+
+        previousTrackedFace = framesSinceFullDetection == 0 ? *largest : trackedFace;
+        trackedFace = *largest;
+    }
+
+    // Region around the tracked face moved by its last displacement.
+    Rect predictRegionOfInterest(const Size& frameSize, float scale) {
+        auto center = (trackedFace.tl() + trackedFace.br()) / 2 + (trackedFace.tl() - previousTrackedFace.tl());
+        Size size((int)(trackedFace.width * scale), (int)(trackedFace.height * scale));
+
+        return Rect(center - Point(size.width / 2, size.height / 2), size) & Rect(Point(), frameSize);
+    }
+
+    // Runs the detector on a downscaled image.
+    // Sizes and found faces are in the coordinates of the original image.
+    void detectScaled(const Mat& image, std::vector<Rect>& faces, Size minSize, Size maxSize, float scale)
     {
-        Mat frame_gray;
-        cvtColor(frame, frame_gray, COLOR_BGR2GRAY);
-        equalizeHist(frame_gray, frame_gray);
+        if (scale == 1) {
+            faceDetector->Detect(image, faces, minSize, maxSize);
+            return;
+        }
 
-        //-- Detect faces
-        std::vector<Rect> faces;
-        face_cascade.detectMultiScale(frame_gray, faces);
+        Mat scaled;
+        resize(image, scaled, Size(), scale, scale, INTER_AREA);
+        faceDetector->Detect(scaled, faces,
+            Size((int)(minSize.width * scale), (int)(minSize.height * scale)),
+            Size((int)(maxSize.width * scale), (int)(maxSize.height * scale)));
 
-        for (size_t i = 0; i < faces.size(); i++)
-        {
-            glm::vec2 center(faces[i].x + faces[i].width / 2, faces[i].y + faces[i].height / 2);
+        for (auto& face : faces)
+            face = Rect((int)(face.x / scale), (int)(face.y / scale), (int)(face.width / scale), (int)(face.height / scale));
+    }
 
-            faceSize.push_back(faces[i].width);
-            facePosition.push_back(center);
+    void detect(const Mat& frame, std::vector<Rect>& faces)
+    {
+        auto& rate = rateController.Get();
 
-            if (faceSize.size() > windowSize)
-                faceSize.pop_front();
-            if (facePosition.size() > windowSize)
-                facePosition.pop_front();
+        //-- Search near the last face first
+        if (useRegionOfInterest && hasTrackedFace && framesSinceFullDetection < fullDetectionInterval) {
+            framesSinceFullDetection++;
 
-            auto distanceToCamera = getDistanceToCamera(faceSize);
-            distanceToCameraBuffer.push_back(distanceToCamera);
-            if (distanceToCameraBuffer.size() > windowSize)
-                distanceToCameraBuffer.pop_front();
-            distanceToCamera = avg(distanceToCameraBuffer);
+            auto roi = predictRegionOfInterest(frame.size(), regionOfInterestScale * rate.regionOfInterestFactor);
+            if (roi.area() > 0) {
+                Size minSize((int)(trackedFace.width * (1 - faceScaleTolerance)), (int)(trackedFace.height * (1 - faceScaleTolerance)));
+                Size maxSize((int)(trackedFace.width * (1 + faceScaleTolerance)), (int)(trackedFace.height * (1 + faceScaleTolerance)));
+                detectScaled(frame(roi), faces, minSize, maxSize, rate.downscale);
 
-            auto pixelToAngle = divide(cameraResolution, cameraViewAngle);
+                for (auto& face : faces)
+                    face += roi.tl();
+
+                if (!faces.empty()) {
+                    track(faces);
+                    return;
+                }
+            }
+        }
+
+        //-- Detect faces on the whole frame
+        framesSinceFullDetection = 0;
+        detectScaled(frame, faces, Size(), Size(), rate.downscale);
+        track(faces);
+    }
+
+    // Searches eyes in the upper half of the face.
+    // Returns the distance between eye centers in pixels or 0 when two eyes weren't found.
+    float detectEyeDistance(const Mat& frame, const Rect& face)
+    {
+        auto region = Rect(face.x, face.y, face.width, face.height / 2) & Rect(Point(), frame.size());
+        if (region.area() == 0)
+            return 0;
+
+        Mat gray;
+        cvtColor(frame(region), gray, COLOR_BGR2GRAY);
+        equalizeHist(gray, gray);
+
+        std::vector<Rect> eyes;
+        eyes_cascade.detectMultiScale(gray, eyes, 1.1, 3, 0, Size(face.width / 8, face.width / 8), Size(face.width / 3, face.width / 3));
+        if (eyes.size() != 2)
+            return 0;
+
+        auto left = (eyes[0].tl() + eyes[0].br()) / 2;
+        auto right = (eyes[1].tl() + eyes[1].br()) / 2;
+        return (float)norm(left - right);
+    }
+
+    // Converts the face rectangle to the raw head position relative to the screen center.
+    glm::vec3 measure(const Rect& face, const Size& frameSize)
+    {
+        glm::vec2 center(face.x + face.width / 2, face.y + face.height / 2);
+
+        auto distanceToCamera = getDistanceToCamera(face.width);
 
-            auto facePositionMedianY = medY(facePosition);
-            auto angleFaceCenterY = (frame.size[0] / 2.f - facePositionMedianY) / pixelToAngle.y;
-            auto alpha = cameraAngle.y - angleFaceCenterY;
-            auto distanceToScreen = distanceToCamera * sin(alpha * degreeToRadian) + screenCenterToCameraDistance.z;
-            distance = distanceToScreen * 1.2;
-            auto posHorizontal = getPosX(frame.size[1] / 2.f, facePosition, distanceToCamera);
-            positionHorizontal = posHorizontal;
+        auto pixelToAngle = divide(cameraResolution, cameraViewAngle);
+
+        auto angleFaceCenterY = (frameSize.height / 2.f - center.y) / pixelToAngle.y;
+        auto alpha = cameraAngle.y - angleFaceCenterY;
+        auto distanceToScreen = distanceToCamera * sin(alpha * degreeToRadian) + screenCenterToCameraDistance.z;
+
+        auto angleFaceCenterX = (frameSize.width / 2.f - center.x) / pixelToAngle.x;
+        auto posHorizontal = distanceToCamera * tan(angleFaceCenterX * degreeToRadian);
 
+        auto posVerticalRelativeToCamera = distanceToCamera * cos(alpha * degreeToRadian);
+        auto posVertical = posVerticalRelativeToCamera - screenCenterToCameraDistance.y;
+
+        return glm::vec3(posHorizontal, posVertical, distanceToScreen * 1.2);
+    }
 
-            auto posVerticalRelativeToCamera = distanceToCamera * cos(alpha * degreeToRadian);
-            auto posVertical = posVerticalRelativeToCamera - screenCenterToCameraDistance.y;
-            positionVertical = posVertical;
+    void processFace(const Detection& detection)
+    {
+        auto measured = detection.hasPosition
+            ? detection.position
+            : measure(detection.face, detection.frameSize);
+        auto filtered = filter->Filter(measured, detection.captured);
 
+        if (detection.eyeDistancePixels > 0) {
+            auto pixelToAngle = divide(cameraResolution, cameraViewAngle);
+            auto angle = detection.eyeDistancePixels / pixelToAngle.x;
+            auto distanceToCamera = getDistanceToCamera(detection.face.width);
+            auto v = distanceToCamera * tan(angle / 2.f * degreeToRadian);
 
+            eyeToCenterDistance = eyeToCenterDistance == 0
+                ? v
+                : eyeToCenterDistance + eyeDistanceSmoothing * (v - eyeToCenterDistance);
         }
 
-        //-- Show what you got
-        //imshow("Capture - Face detection", frame);
+        // Published as a whole so readers never mix values of different frames.
+        headPoses.Write({ filtered, filter->GetVelocity(), detection.captured, eyeToCenterDistance });
+
+        // Position the viewer's head will have when the frame is displayed.
+        auto position = filter->Predict(detection.captured + predictionTime);
+
+        positionHorizontal = position.x;
+        positionVertical = position.y;
+        distance = position.z;
+
+        if (recorder.IsOpen())
+            recorder.Write(detection.captured, position, measured);
+
+        if (glm::length(filtered - notifiedPosition) > poseChangeThreshold) {
+            notifiedPosition = filtered;
+            onPoseChanged();
+        }
     }
 
-    void distanceProcess() {
+    // Capture stage. Runs until the camera fails or processing is stopped.
+    void captureProcess() {
         while (!mustStopPositionProcessing)
         {
-            if (!ProcessFrame())
+            // A new Mat each time since the previous one may still be read by detection.
+            TrackingSample sample;
+            if (!source || !source->Read(sample))
+                break;
+
+            if (!sample.hasPosition && sample.image.empty())
+            {
+                log.Error("No captured frame\n");
                 break;
+            }
+
+            capturedFrames.Write(sample);
+            hasCapturedFrame.Signal();
         }
+
+        mustStopPositionProcessing = true;
+        hasCapturedFrame.Signal();
+        hasDetection.Signal();
     }
 
-    bool ProcessFrame() {
-        Mat frame;
-        if (capture.read(frame))
+    // Detection stage. Always works on the newest captured frame.
+    void detectionProcess() {
+        pinTrackingThread();
+
+        TrackingSample sample;
+        std::vector<Rect> faces;
+        int skippedFrames = 0;
+        rateController.Reset();
+        while (!mustStopPositionProcessing)
         {
-            if (frame.empty())
+            if (!capturedFrames.Read(sample))
             {
-                log.Error("No captured frame\n");
-                return false;
+                hasCapturedFrame.Wait();
+                continue;
             }
 
-            detectAndDisplay(frame);
-            return true;
+            if (sample.hasPosition) {
+                if (!detections.TryPush({ Rect(), Size(), sample.captured, true, sample.position, 0 }))
+                    log.Warning("Detection queue is full. Sample is dropped");
+                hasDetection.Signal();
+                continue;
+            }
+
+            if (++skippedFrames < rateController.Get().detectionInterval)
+                continue;
+            skippedFrames = 0;
+
+            detect(sample.image, faces);
+
+            auto eyeDistance = hasTrackedFace && shouldDetectEyes ? detectEyeDistance(sample.image, trackedFace) : 0;
+
+            rateController.ReportLatency(std::chrono::duration<float>(PositionFilter::Clock::now() - sample.captured).count());
+
+            if (!hasTrackedFace)
+                continue;
+
+            // Only the tracked viewer drives the camera.
+            if (!detections.TryPush({ trackedFace, sample.image.size(), sample.captured, false, glm::vec3(), eyeDistance }))
+                log.Warning("Detection queue is full. Face is dropped");
+            hasDetection.Signal();
         }
+    }
 
-        return false;
+    // Filtering stage. Smooths detections and publishes the position.
+    void filterProcess() {
+        pinTrackingThread();
+
+        Detection detection;
+        filter->Reset();
+        while (!mustStopPositionProcessing)
+        {
+            if (!detections.TryPop(detection))
+            {
+                hasDetection.Wait();
+                continue;
+            }
+
+            processFace(detection);
+        }
+    }
+
+    PositionRecorder recorder;
+
+    // Filter -> render loop.
+    TripleBuffer<HeadPose> headPoses;
+    // Last pose read by the render loop.
+    HeadPose headPose;
+    // Position onPoseChanged was last invoked for.
+    glm::vec3 notifiedPosition;
+
+    void pinTrackingThread() {
+        if (shouldPinThreads && !ThreadAffinity::PinTrackingThread())
+            log.Warning("Tracking thread could not be pinned");
+    }
+
+    void distanceProcess() {
+        if (!isInitialized) {
+            log.Error("Position detection wasn't initialized");
+            return;
+        }
+
+        pinTrackingThread();
+
+        detectionThread = std::thread([&] { detectionProcess(); });
+        filterThread = std::thread([&] { filterProcess(); });
+
+        captureProcess();
+
+        detectionThread.join();
+        filterThread.join();
+
+        recorder.Close();
     }
 
 
@@ -199,6 +878,10 @@ public:
 
     std::function<void()> onStartProcess = [] {};
     std::function<void()> onStopProcess = [] {};
+    // Invoked from the tracking thread when the head moved more than
+    // poseChangeThreshold millimeters since the previous invocation.
+    std::function<void()> onPoseChanged = [] {};
+    float poseChangeThreshold = 1;
 
 
     const float degreeToRadian = 3.1415926f * 2 / 360;
@@ -211,38 +894,234 @@ public:
     glm::vec2 cameraViewAngle = glm::vec2(47, 35);
     glm::vec2 cameraAngle = glm::vec2(0, 65);
 
+    // Track-then-detect mode.
+    // After a face is found only the region around it is searched.
+    // Full frame is searched when the face is lost or every fullDetectionInterval frames.
+    bool useRegionOfInterest = true;
+    int fullDetectionInterval = 30;
+    // Region of interest size relative to the face size.
+    float regionOfInterestScale = 2;
+    // Allowed face size change between frames.
+    float faceScaleTolerance = 0.3;
+
+    // Input of the detector. Camera by default.
+    // Replace before starting position detection.
+    std::unique_ptr<TrackingSource> source = std::make_unique<CameraSource>();
+    // Published positions are written to this file when not empty.
+    std::string recordFileName;
+
+    // Smoothing of the measured position.
+    // Replace before starting position detection.
+    std::unique_ptr<PositionFilter> filter = std::make_unique<OneEuroPositionFilter>();
+    // Expected time between capturing a frame and displaying the image rendered for it.
+    std::chrono::milliseconds predictionTime = std::chrono::milliseconds(40);
+    // Expected time between rendering and displaying a frame.
+    std::chrono::milliseconds displayLatency = std::chrono::milliseconds(16);
+    // Limits extrapolation when tracking stalls or the face is lost.
+    std::chrono::milliseconds maxExtrapolation = std::chrono::milliseconds(100);
+
+    FaceDetectorBackend backend = FaceDetectorBackend::Haar;
+    // Measure the distance between eyes to drive the camera's eye distance.
+    bool shouldDetectEyes = false;
+    // Weight of a new eye distance measurement.
+    float eyeDistanceSmoothing = 0.05;
+
+    // Adapts tracking to the render frame time and tracker latency.
+    TrackerRateController rateController;
+    // Keep tracking threads off the render thread's core.
+    bool shouldPinThreads = false;
+
     // Millimeters
     float faceSizeRealY = 165;
     glm::vec3 screenCenterToCameraDistance = glm::vec3(0, 170, 30);
 
 
+    // Head position extrapolated to the moment the current frame is displayed.
+    // Must be called from a single thread (the render loop).
+    glm::vec3 GetHeadPosition() {
+        headPoses.Read(headPose);
+        return headPose.At(PositionFilter::Clock::now() + displayLatency, maxExtrapolation);
+    }
+    // Measured distance from an eye to the center between eyes.
+    // 0 when unknown. Must be called after GetHeadPosition.
+    float GetEyeToCenterDistance() const {
+        return headPose.eyeToCenterDistance;
+    }
+
+    static std::unique_ptr<FaceDetector> CreateFaceDetector(FaceDetectorBackend backend) {
+        switch (backend) {
+        case FaceDetectorBackend::Lbp:
+            return std::make_unique<CascadeFaceDetector>("lbpcascades/lbpcascade_frontalface_improved.xml");
+        case FaceDetectorBackend::Dnn:
+            return std::make_unique<DnnFaceDetector>();
+        default:
+            return std::make_unique<CascadeFaceDetector>("haarcascades/haarcascade_frontalface_alt.xml");
+        }
+    }
+    static const char* GetBackendName(FaceDetectorBackend backend) {
+        switch (backend) {
+        case FaceDetectorBackend::Lbp: return "lbp";
+        case FaceDetectorBackend::Dnn: return "dnn";
+        default: return "haar";
+        }
+    }
+    static FaceDetectorBackend ParseBackend(const std::string& name) {
+        for (auto b : { FaceDetectorBackend::Haar, FaceDetectorBackend::Lbp, FaceDetectorBackend::Dnn })
+            if (name == GetBackendName(b))
+                return b;
+
+        return FaceDetectorBackend::Haar;
+    }
+
+    // Runs every backend over a recorded video as fast as possible
+    // and logs detections per second and jitter of the face center.
+    // Residual of the face center against its centered moving average.
+    // Steady head motion is followed by the average
+    // so unlike the frame to frame displacement it isn't counted as jitter.
+    static void AccumulateJitter(const std::vector<Point2d>& track, double& squaredResidual, int& count) {
+        const int radius = 2;
+
+        for (int i = radius; i + radius < (int)track.size(); i++) {
+            Point2d mean(0, 0);
+            for (int j = i - radius; j <= i + radius; j++)
+                mean += track[j];
+            mean *= 1.0 / (2 * radius + 1);
+
+            auto d = track[i] - mean;
+            squaredResidual += d.dot(d);
+            count++;
+        }
+    }
+
+    static void Benchmark(const std::string& videoPath, const std::atomic<bool>& mustStop) {
+        auto log = Log::For<PositionDetector>();
+
+        for (auto backend : { FaceDetectorBackend::Haar, FaceDetectorBackend::Lbp, FaceDetectorBackend::Dnn }) {
+            if (mustStop)
+                return;
+
+            auto detector = CreateFaceDetector(backend);
+            if (!detector->Init()) {
+                log.Warning("Benchmark: backend ", GetBackendName(backend), " could not be loaded");
+                continue;
+            }
+
+            VideoSource video(videoPath);
+            video.isRealTime = false;
+            if (!video.Open()) {
+                log.Error("Benchmark: could not open ", videoPath);
+                return;
+            }
+
+            int frames = 0, detectedFrames = 0, jitterSamples = 0;
+            double squaredJitter = 0;
+            // Face centers of consecutive frames with a detection.
+            std::vector<Point2d> track;
+            std::vector<Rect> faces;
+            TrackingSample sample;
+
+            auto start = PositionFilter::Clock::now();
+            while (!mustStop && video.Read(sample)) {
+                detector->Detect(sample.image, faces);
+                frames++;
+
+                if (faces.empty()) {
+                    AccumulateJitter(track, squaredJitter, jitterSamples);
+                    track.clear();
+                    continue;
+                }
+
+                auto largest = std::max_element(faces.begin(), faces.end(), [](const Rect& a, const Rect& b) { return a.area() < b.area(); });
+                track.push_back(Point2d(largest->tl() + largest->br()) * 0.5);
+                detectedFrames++;
+            }
+            AccumulateJitter(track, squaredJitter, jitterSamples);
+            auto seconds = std::chrono::duration<double>(PositionFilter::Clock::now() - start).count();
+
+            if (mustStop)
+                return;
+
+            log.Information(
+                "Benchmark: ", GetBackendName(backend),
+                " frames: ", frames,
+                " detected: ", detectedFrames,
+                " detections per second: ", seconds > 0 ? frames / seconds : 0,
+                " jitter (px): ", jitterSamples > 0 ? sqrt(squaredJitter / jitterSamples) : 0);
+        }
+    }
+
+    // Runs Benchmark on a separate thread.
+    // Does nothing while the previous run isn't finished.
+    void StartBenchmark(const std::string& videoPath) {
+        if (isBenchmarkRunning || videoPath.empty())
+            return;
+
+        if (benchmarkThread.joinable())
+            benchmarkThread.join();
+
+        isBenchmarkRunning = true;
+        mustStopBenchmark = false;
+        benchmarkThread = std::thread([this, videoPath] {
+            Benchmark(videoPath, mustStopBenchmark);
+            isBenchmarkRunning = false;
+        });
+    }
+    // Stops the benchmark after the frame being detected.
+    void StopBenchmark() {
+        mustStopBenchmark = true;
+
+        if (benchmarkThread.joinable())
+            benchmarkThread.join();
+    }
+
+    // Path with a .csv extension is a trajectory, anything else is a video.
+    // Empty path means the camera.
+    static std::unique_ptr<TrackingSource> CreateSource(const std::string& path) {
+        if (path.empty())
+            return std::make_unique<CameraSource>();
+        if (fs::path(path).extension() == ".csv")
+            return std::make_unique<TrajectorySource>(path);
+
+        return std::make_unique<VideoSource>(path);
+    }
+
     bool Init() {
-        String face_cascade_name = samples::findFile("haarcascades/haarcascade_frontalface_alt.xml");
-        String eyes_cascade_name = samples::findFile("haarcascades/haarcascade_eye_tree_eyeglasses.xml");
+        isInitialized = false;
 
-        //-- 1. Load the cascades
-        if (!face_cascade.load(face_cascade_name))
-        {
-            log.Error("Error loading face cascade");
-            return false;
-        };
-        if (!eyes_cascade.load(eyes_cascade_name))
-        {
-            log.Error("Error loading eyes cascade");
-            return false;
-        };
+        //-- 1. Load the detectors
+        // Trajectories are replayed without detection.
+        if (source && source->ProducesFrames()) {
+            String eyes_cascade_name = samples::findFile("haarcascades/haarcascade_eye_tree_eyeglasses.xml");
+
+            faceDetector = CreateFaceDetector(backend);
+            if (!faceDetector->Init())
+            {
+                log.Error("Error loading ", GetBackendName(backend), " face detector");
+                return false;
+            };
+            if (!eyes_cascade.load(eyes_cascade_name))
+            {
+                log.Error("Error loading eyes cascade");
+                return false;
+            };
+        }
 
-        int camera_device = 0;
         //-- 2. Read the video stream
-        capture.open(camera_device);
-        if (!capture.isOpened())
+        if (!source || !source->Open())
         {
             log.Error("Error opening video capture\n");
             return false;
         }
 
+        if (!recordFileName.empty() && !recorder.Open(recordFileName))
+            log.Error("Error opening position record file ", recordFileName);
+
         setUseOptimized(true);
 
+        // Latency beyond the prediction time shows up as lag.
+        rateController.latencyBudget = std::chrono::duration<float>(predictionTime).count();
+
+        isInitialized = true;
         return true;
     }
 
@@ -253,7 +1132,8 @@ public:
         isPositionProcessingWorking = true;
         mustStopPositionProcessing = false;
 
-        // A separate thread for position detection
+        // A separate thread for position detection.
+        // It runs capture itself and spawns detection and filtering stages.
         distanceProcessThread = std::thread([=]() {
             onStartProcess();
             distanceProcess();
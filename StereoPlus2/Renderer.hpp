@@ -3,6 +3,10 @@
 #include "DomainTypes.hpp"
 #include "GUI.hpp"
 #include "Windows.hpp"
+#include "StereoOutput.hpp"
+#include "ShaderManager.hpp"
+#include "Instancing.hpp"
+#include "GPUProfiler.hpp"
 #include <vector>
 #include <string>
 #include <fstream>
@@ -11,6 +15,13 @@
 
 using namespace std;
 
+enum class LineRenderMode {
+	// Hardware lines, overlap found with stencil bits and a full screen pass.
+	Stencil,
+	// Lines expanded into anti aliased quads, overlap found with additive blending.
+	Smooth,
+};
+
 // GL4.1 required
 class Renderer {
 	const int stencilBufferMaskBright1 = 0x1;
@@ -23,6 +34,14 @@ class Renderer {
 
 
 	GLuint ShaderLeft, ShaderRight;
+	GLuint LineShaderLeft, LineShaderRight;
+	// Same as above with vertices projected per instance.
+	GLuint InstancedShaderLeft, InstancedShaderRight;
+	GLuint InstancedLineShaderLeft, InstancedLineShaderRight;
+	GLuint ComposeShader;
+
+	EyeTarget eyeTargets[2];
+	EyeWindow eyeWindows[2];
 
 	static void glfw_error_callback(int error, const char* description)
 	{
@@ -82,144 +101,438 @@ class Renderer {
 
 	void CreateShaders()
 	{
-		std::string vertexShaderSource1		   = GLLoader::ReadShader("shaders/.vert");
-		std::string fragmentShaderSourceLeft1  = GLLoader::ReadShader("shaders/Left.frag");
-		std::string fragmentShaderSourceRight1 = GLLoader::ReadShader("shaders/Right.frag");
+		ShaderManager::Load(ShaderLeft, { "shaders/.vert", "shaders/Left.frag" });
+		ShaderManager::Load(ShaderRight, { "shaders/.vert", "shaders/Right.frag" });
 
-		const char* vertexShaderSource = vertexShaderSource1.c_str();
-		const char* fragmentShaderSourceLeft = fragmentShaderSourceLeft1.c_str();
-		const char* fragmentShaderSourceRight = fragmentShaderSourceRight1.c_str();
+		// Both eyes share the line shaders and differ only by color.
+		ShaderManager::Load(LineShaderLeft, { "shaders/.vert", "shaders/Line.geom", "shaders/Line.frag" });
+		ShaderManager::Load(LineShaderRight, { "shaders/.vert", "shaders/Line.geom", "shaders/Line.frag" });
 
-		ShaderLeft = GLLoader::CreateShaderProgram(vertexShaderSource, fragmentShaderSourceLeft);
-		ShaderRight = GLLoader::CreateShaderProgram(vertexShaderSource, fragmentShaderSourceRight);
+		ShaderManager::Load(InstancedShaderLeft, { "shaders/Instanced.vert", "shaders/Left.frag" });
+		ShaderManager::Load(InstancedShaderRight, { "shaders/Instanced.vert", "shaders/Right.frag" });
+		ShaderManager::Load(InstancedLineShaderLeft, { "shaders/Instanced.vert", "shaders/Line.geom", "shaders/Line.frag" });
+		ShaderManager::Load(InstancedLineShaderRight, { "shaders/Instanced.vert", "shaders/Line.geom", "shaders/Line.frag" });
 
-		UpdateShaderColor(Settings::ColorLeft().Get(), Settings::ColorRight().Get());
+		ShaderManager::Load(ComposeShader, { "shaders/Compose.vert", "shaders/Compose.frag" });
+		// White squares load their programs before.
+		ShaderManager::PruneCache();
 
+		UpdateShaderColor(Settings::ColorLeft().Get(), Settings::ColorRight().Get());
+		UpdateWhiteSquareColors();
+	}
+	// Other uniforms are set every frame.
+	void UpdateWhiteSquareColors() {
 		UpdateShaderColor(whiteSquare.ShaderProgram, whiteColorBright, "myColor");
 		UpdateShaderColor(whiteSquareDim.ShaderProgram, whiteColorDim, "myColor");
 	}
 	void UpdateShaderColor(glm::vec4 colorLeft, glm::vec4 colorRight) {
 		// Available since GL4.1
-		UpdateShaderColor(ShaderLeft, colorLeft, "myColor");
-		UpdateShaderColor(ShaderRight, colorRight, "myColor");
+		UpdateShaderColor(GetShaderLeft(), colorLeft, "myColor");
+		UpdateShaderColor(GetShaderRight(), colorRight, "myColor");
+		UpdateShaderColor(GetInstancedShaderLeft(), colorLeft, "myColor");
+		UpdateShaderColor(GetInstancedShaderRight(), colorRight, "myColor");
 	}
 	void UpdateShaderColor(GLuint shader, glm::vec4 color, const char* name) {
-		// Available since GL4.1
-		glProgramUniform4f(shader, glGetUniformLocation(shader, name), color.r, color.g, color.b, color.a);
+		GLState::ProgramUniform4f(shader, name, color.r, color.g, color.b, color.a);
+	}
+	// The white square always covers the whole view so only object shaders are transformed.
+	void UpdateTileTransform(const glm::vec4& v) {
+		for (auto shader : { ShaderLeft, ShaderRight, LineShaderLeft, LineShaderRight,
+			InstancedShaderLeft, InstancedShaderRight, InstancedLineShaderLeft, InstancedLineShaderRight })
+			GLState::ProgramUniform4f(shader, "tileTransform", v.x, v.y, v.z, v.w);
+	}
+	// Instances are projected by the vertex shader with the camera of the frame.
+	void UpdateInstanceProjection(Camera* camera) {
+		auto millimetersToView = camera->GetMillimetersToView();
+		auto position = camera->GetViewPosition();
+		auto eyeShift = camera->GetViewEyeToCenterDistance();
+
+		for (auto [left, right] : { std::make_pair(InstancedShaderLeft, InstancedShaderRight), std::make_pair(InstancedLineShaderLeft, InstancedLineShaderRight) }) {
+			for (auto shader : { left, right }) {
+				GLState::ProgramUniform3f(shader, "millimetersToView", millimetersToView.x, millimetersToView.y, millimetersToView.z);
+				GLState::ProgramUniform3f(shader, "cameraPosition", position.x, position.y, position.z);
+			}
+			GLState::ProgramUniform1f(left, "eyeShift", -eyeShift);
+			GLState::ProgramUniform1f(right, "eyeShift", eyeShift);
+		}
+	}
+	// Line width is kept in pixels of the current viewport.
+	void UpdateLineShaders() {
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+
+		for (auto shader : { LineShaderLeft, LineShaderRight, InstancedLineShaderLeft, InstancedLineShaderRight }) {
+			GLState::ProgramUniform2f(shader, "viewportSize", viewport[2], viewport[3]);
+			GLState::ProgramUniform1f(shader, "lineWidth", LineThickness);
+		}
 	}
 
-	void DrawSquare(const WhiteSquare& square) {
-		glBindVertexArray(square.VAOLeftTop);
-		glBindBuffer(GL_ARRAY_BUFFER, square.VBOLeftTop);
-		glBufferData(GL_ARRAY_BUFFER, WhiteSquare::VerticesSize, square.vertices, GL_STREAM_DRAW);
-
-		glVertexAttribPointer(GL_POINTS, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(GL_POINTS);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLuint GetShaderLeft() {
+		return lineRenderMode == LineRenderMode::Smooth ? LineShaderLeft : ShaderLeft;
+	}
+	GLuint GetShaderRight() {
+		return lineRenderMode == LineRenderMode::Smooth ? LineShaderRight : ShaderRight;
+	}
+	GLuint GetInstancedShaderLeft() {
+		return lineRenderMode == LineRenderMode::Smooth ? InstancedLineShaderLeft : InstancedShaderLeft;
+	}
+	GLuint GetInstancedShaderRight() {
+		return lineRenderMode == LineRenderMode::Smooth ? InstancedLineShaderRight : InstancedShaderRight;
+	}
 
-		// Apply shader
-		glUseProgram(square.ShaderProgram);
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	// Colors are set once per pass rather than per object.
+	void BeginBright() {
+		UpdateShaderColor(Settings::ColorLeft().Get(), Settings::ColorRight().Get());
+	}
+	void BeginDim() {
+		UpdateShaderColor(Settings::DimmedColorLeft().Get(), Settings::DimmedColorRight().Get());
 	}
 
 	void DrawBright(Camera* camera, SceneObject* o) {
-		UpdateShaderColor(Settings::ColorLeft().Get(), Settings::ColorRight().Get());
 		o->Draw(
 			[&camera](const glm::vec3& p) { return camera->GetLeft(p); },
 			[&camera](const glm::vec3& p) { return camera->GetRight(p); },
-			ShaderLeft,
-			ShaderRight,
+			GetShaderLeft(),
+			GetShaderRight(),
 			stencilBufferMaskBright1,
 			stencilBufferMaskBright2);
 	}
 	void DrawDim(Camera* camera, SceneObject* o) {
-		UpdateShaderColor(Settings::DimmedColorLeft().Get(), Settings::DimmedColorRight().Get());
 		o->Draw(
 			[&camera](const glm::vec3& p) { return camera->GetLeft(p); },
 			[&camera](const glm::vec3& p) { return camera->GetRight(p); },
-			ShaderLeft,
-			ShaderRight,
+			GetShaderLeft(),
+			GetShaderRight(),
 			stencilBufferMaskDim1,
 			stencilBufferMaskDim2);
 	}
 
-	void DrawIntersection(const WhiteSquare& square, GLuint stencilMask) {
-		glStencilMask(0x00);
+	// Same stencil marks as SceneObject::Draw.
+	void DrawInstances(InstancedObjects& instances, GLuint stencilMaskLeft, GLuint stencilMaskRight) {
+		instances.Update();
+
+		GLState::StencilMask(stencilMaskLeft);
+		GLState::StencilFunc(GL_ALWAYS, stencilMaskLeft, stencilMaskLeft | stencilMaskRight);
+		GLState::StencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE);
+		instances.Draw(GetInstancedShaderLeft());
 
-		glStencilFunc(GL_EQUAL, stencilMask, stencilMask);
-		glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-		DrawSquare(square);
+		GLState::StencilMask(stencilMaskRight);
+		GLState::StencilFunc(GL_ALWAYS, stencilMaskRight, stencilMaskLeft | stencilMaskRight);
+		GLState::StencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE);
+		instances.Draw(GetInstancedShaderRight());
 	}
 
-public:
-	GLFWwindow* glWindow;
-	const char* glsl_version;
-	float LineThickness = 1;
-	glm::vec4 backgroundColor = glm::vec4(0, 0, 0, 0);
+	// Objects drawn with bright and dim colors.
+	// Rebuilt only when the selection or the hierarchy changes.
+	std::vector<SceneObject*> brightObjects;
+	std::vector<SceneObject*> dimObjects;
+	// Clones of traces taken out of the lists above.
+	InstancedObjects brightInstances;
+	InstancedObjects dimInstances;
+	bool shouldUpdateDrawLists = true;
+	size_t drawListsHierarchyVersion = 0;
+
+	void UpdateDrawLists(Scene& scene) {
+		if (!shouldUpdateDrawLists && drawListsHierarchyVersion == SceneObject::HierarchyVersion())
+			return;
+
+		brightObjects.clear();
+		dimObjects.clear();
+
+		if (ObjectSelection::Selected().empty())
+			for (auto& o : scene.Objects().Get())
+				brightObjects.push_back(o.Get());
+		else {
+			for (auto& o : scene.Objects().Get())
+				if (!o.IsSelected())
+					dimObjects.push_back(o.Get());
 
-	WhiteSquare whiteSquare;
-	WhiteSquare whiteSquareDim;
+			for (auto& h : ObjectSelection::Selected())
+				if (PON o(h); o.HasValue())
+					brightObjects.push_back(o.Get());
+		}
 
-	void Pipeline(Scene& scene) {
-		glDisable(GL_DEPTH_TEST);
+		brightInstances.Take(brightObjects);
+		dimInstances.Take(dimObjects);
+
+		shouldUpdateDrawLists = false;
+		drawListsHierarchyVersion = SceneObject::HierarchyVersion();
+	}
+
+	void DrawIntersection(const WhiteSquare& square, GLuint stencilMask) {
+		GLState::StencilMask(0x00);
+
+		GLState::StencilFunc(GL_EQUAL, stencilMask, stencilMask);
+		GLState::StencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+		square.Draw();
+	}
+
+	void Clear() {
 		glClearColor(backgroundColor.r, backgroundColor.g, backgroundColor.b, backgroundColor.a);
 
 		// This is required before clearing Stencil buffer.
 		// Don't know why though.
 		// ~ is bitwise negation 
-		glStencilMask(~0);
+		GLState::StencilMask(~0);
 
 		glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-		glLineWidth(LineThickness);
+	}
 
-		glEnable(GL_STENCIL_TEST);
+	void PipelineAnaglyph(Scene& scene) {
+		GPUProfiler::Begin("clear");
+		Clear();
+		GPUProfiler::End();
 
-		// Anti aliasing
-		{
-			//glEnable(GL_LINE_SMOOTH);
-			//glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-			//glEnable(GL_BLEND);
-			//glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+		if (lineRenderMode == LineRenderMode::Smooth)
+			PipelineSmooth(scene);
+		else
+			PipelineStencil(scene);
+	}
+
+	void UpdateBuffers(Camera* camera, SceneObject* o) {
+		o->UpdateBuffers(
+			[&camera](const glm::vec3& p) { return camera->GetLeft(p); },
+			[&camera](const glm::vec3& p) { return camera->GetRight(p); });
+	}
+	// Eyes are drawn white and dimmed white since they are separated by the display.
+	void DrawEye(Scene& scene, bool isLeft) {
+		auto shader = isLeft ? GetShaderLeft() : GetShaderRight();
+
+		if (lineRenderMode == LineRenderMode::Smooth) {
+			UpdateLineShaders();
+			glEnable(GL_BLEND);
+			glBlendEquation(GL_MAX);
 		}
-		
-		if (ObjectSelection::Selected().empty()) {
-			for (auto o : scene.Objects().Get())
-				DrawBright(scene.camera, o.Get());
-			DrawBright(scene.camera, &scene.cross().Get());
-			DrawIntersection(whiteSquare, stencilBufferMaskBright1 | stencilBufferMaskBright2);
+		else
+			glLineWidth(LineThickness);
+
+		auto instancedShader = isLeft ? GetInstancedShaderLeft() : GetInstancedShaderRight();
+
+		UpdateShaderColor(shader, whiteColorDim, "myColor");
+		UpdateShaderColor(instancedShader, whiteColorDim, "myColor");
+		for (auto o : dimObjects)
+			o->DrawEye(isLeft, shader);
+		dimInstances.Draw(instancedShader);
+
+		UpdateShaderColor(shader, whiteColorBright, "myColor");
+		UpdateShaderColor(instancedShader, whiteColorBright, "myColor");
+		for (auto o : brightObjects)
+			o->DrawEye(isLeft, shader);
+		brightInstances.Draw(instancedShader);
+		scene.cross()->DrawEye(isLeft, shader);
+
+		if (lineRenderMode == LineRenderMode::Smooth) {
+			glBlendEquation(GL_FUNC_ADD);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glDisable(GL_BLEND);
 		}
-		else {
-			std::set<PON> objectsSorted;
-			for (auto o : scene.Objects().Get())
-				objectsSorted.emplace(o);
+	}
+	// Renders each eye to its own target and composes them into the current framebuffer.
+	// Projections are calculated once for both eyes as in the anaglyph mode.
+	void PipelineEyes(Scene& scene) {
+		GLint framebuffer;
+		GLint viewport[4];
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		auto size = glm::ivec2(viewport[2], viewport[3]);
+
+		GPUProfiler::Begin("buffers");
+		for (auto o : dimObjects)
+			UpdateBuffers(scene.camera, o);
+		for (auto o : brightObjects)
+			UpdateBuffers(scene.camera, o);
+		UpdateBuffers(scene.camera, &scene.cross().Get());
+		dimInstances.Update();
+		brightInstances.Update();
+		GPUProfiler::End();
+
+		for (int i = 0; i < 2; i++) {
+			GPUProfiler::Begin(i == 0 ? "left eye" : "right eye");
+			eyeTargets[i].Resize(size);
+			glViewport(0, 0, size.x, size.y);
+			Clear();
+			DrawEye(scene, i == 0);
+			GPUProfiler::End();
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+		// Dual windows are previewed side by side.
+		auto mode = outputMode == StereoOutputMode::DualWindow ? StereoOutputMode::SideBySide : outputMode;
+
+		GPUProfiler::Begin("compose");
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, eyeTargets[1].texture);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, eyeTargets[0].texture);
 
-			std::vector<PON> dimObjects;
+		GLState::ProgramUniform1i(ComposeShader, "leftEye", 0);
+		GLState::ProgramUniform1i(ComposeShader, "rightEye", 1);
+		GLState::ProgramUniform1i(ComposeShader, "mode", (GLint)mode);
+		whiteSquare.Draw(ComposeShader);
 
-			std::set_difference(
-				objectsSorted.begin(),
-				objectsSorted.end(),
-				ObjectSelection::Selected().begin(),
-				ObjectSelection::Selected().end(),
-				std::inserter(dimObjects, dimObjects.begin()));
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		GPUProfiler::End();
+	}
+
+	void PipelineStencil(Scene& scene) {
+		glLineWidth(LineThickness);
 
+		glEnable(GL_STENCIL_TEST);
+
+		if (!dimObjects.empty() || !dimInstances.IsEmpty()) {
+			GPUProfiler::Begin("dim pass");
+			BeginDim();
 			for (auto o : dimObjects)
-				DrawDim(scene.camera, o.Get());
-			DrawIntersection(whiteSquareDim, stencilBufferMaskDim1 | stencilBufferMaskDim2);
+				DrawDim(scene.camera, o);
+			DrawInstances(dimInstances, stencilBufferMaskDim1, stencilBufferMaskDim2);
+			GPUProfiler::End();
 
-			for (auto o : ObjectSelection::Selected())
-				if (o.HasValue())
-					DrawBright(scene.camera, o.Get());
-			DrawBright(scene.camera, &scene.cross().Get());
-			DrawIntersection(whiteSquare, stencilBufferMaskBright1 | stencilBufferMaskBright2);
+			GPUProfiler::Begin("dim intersection");
+			DrawIntersection(whiteSquareDim, stencilBufferMaskDim1 | stencilBufferMaskDim2);
+			GPUProfiler::End();
 		}
 
-		// Anti aliasing
-		//glDisable(GL_LINE_SMOOTH | GL_BLEND);
+		GPUProfiler::Begin("bright pass");
+		BeginBright();
+		for (auto o : brightObjects)
+			DrawBright(scene.camera, o);
+		DrawInstances(brightInstances, stencilBufferMaskBright1, stencilBufferMaskBright2);
+		DrawBright(scene.camera, &scene.cross().Get());
+		GPUProfiler::End();
+
+		GPUProfiler::Begin("bright intersection");
+		DrawIntersection(whiteSquare, stencilBufferMaskBright1 | stencilBufferMaskBright2);
+		GPUProfiler::End();
 
 		glDisable(GL_STENCIL_TEST);
+	}
+	// Colors take the maximum so red and cyan overlap into white within the same pass,
+	// while joints and dense strokes drawn several times don't get brighter than a single segment.
+	// Alpha takes the maximum as well to keep the dimmed colors translucent where they overlap.
+	void PipelineSmooth(Scene& scene) {
+		UpdateLineShaders();
+
+		glEnable(GL_BLEND);
+		glBlendEquation(GL_MAX);
+
+		GPUProfiler::Begin("dim pass");
+		BeginDim();
+		for (auto o : dimObjects)
+			DrawDim(scene.camera, o);
+		DrawInstances(dimInstances, stencilBufferMaskDim1, stencilBufferMaskDim2);
+		GPUProfiler::End();
+
+		GPUProfiler::Begin("bright pass");
+		BeginBright();
+		for (auto o : brightObjects)
+			DrawBright(scene.camera, o);
+		DrawInstances(brightInstances, stencilBufferMaskBright1, stencilBufferMaskBright2);
+		DrawBright(scene.camera, &scene.cross().Get());
+		GPUProfiler::End();
+
+		glBlendEquation(GL_FUNC_ADD);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glDisable(GL_BLEND);
+	}
+
+public:
+	GLFWwindow* glWindow;
+	const char* glsl_version;
+	float LineThickness = 1;
+	LineRenderMode lineRenderMode = LineRenderMode::Stencil;
+	StereoOutputMode outputMode = StereoOutputMode::Anaglyph;
+	glm::vec4 backgroundColor = glm::vec4(0, 0, 0, 0);
+
+	WhiteSquare whiteSquare;
+	WhiteSquare whiteSquareDim;
+
+	void Pipeline(Scene& scene) {
+		GPUProfiler::Scope profilerScope("pipeline");
+
+		// Bindings may have been changed by ImGui since the last frame.
+		GLState::Invalidate();
+
+		if (ShaderManager::CheckForChanges())
+			UpdateWhiteSquareColors();
+
+		glDisable(GL_DEPTH_TEST);
+
+		UpdateTileTransform(Stereo::TileTransform());
+		UpdateInstanceProjection(scene.camera);
+		LevelOfDetail::PixelsPerViewUnit() = scene.camera->ViewSize.Get() * 0.5f;
+		
+		UpdateDrawLists(scene);
+
+		// Composition would be repeated in every tile of a larger image
+		// so tiles are always rendered as anaglyph.
+		if (outputMode == StereoOutputMode::Anaglyph || Stereo::TileTransform() != glm::vec4(1, 1, 0, 0))
+			PipelineAnaglyph(scene);
+		else
+			PipelineEyes(scene);
+
 		glEnable(GL_DEPTH_TEST);
 	}
 
+	void SetOutputMode(StereoOutputMode mode) {
+		outputMode = mode;
+
+		if (mode == StereoOutputMode::DualWindow) {
+			eyeWindows[0].Open(glWindow, LocaleProvider::GetC("leftEye"));
+			eyeWindows[1].Open(glWindow, LocaleProvider::GetC("rightEye"));
+		}
+		else
+			for (auto& w : eyeWindows)
+				w.Close();
+	}
+	// Shows the last rendered eyes in their windows.
+	// Returns false when a window was closed by the user.
+	bool PresentEyeWindows() {
+		if (outputMode != StereoOutputMode::DualWindow)
+			return true;
+
+		for (int i = 0; i < 2; i++) {
+			if (eyeWindows[i].ShouldClose())
+				return false;
+
+			eyeWindows[i].Present(eyeTargets[i].texture, eyeTargets[i].size);
+		}
+		return true;
+	}
+
+	static const char* GetStereoOutputModeName(StereoOutputMode mode) {
+		switch (mode) {
+		case StereoOutputMode::SideBySide: return "sideBySide";
+		case StereoOutputMode::TopBottom: return "topBottom";
+		case StereoOutputMode::Interlaced: return "interlaced";
+		case StereoOutputMode::DualWindow: return "dualWindow";
+		default: return "anaglyph";
+		}
+	}
+	static StereoOutputMode ParseStereoOutputMode(const std::string& name) {
+		for (auto mode : { StereoOutputMode::SideBySide, StereoOutputMode::TopBottom, StereoOutputMode::Interlaced, StereoOutputMode::DualWindow })
+			if (name == GetStereoOutputModeName(mode))
+				return mode;
+
+		return StereoOutputMode::Anaglyph;
+	}
+
+	static const char* GetLineRenderModeName(LineRenderMode mode) {
+		switch (mode) {
+		case LineRenderMode::Smooth: return "smooth";
+		default: return "stencil";
+		}
+	}
+	static LineRenderMode ParseLineRenderMode(const std::string& name) {
+		return name == GetLineRenderModeName(LineRenderMode::Smooth)
+			? LineRenderMode::Smooth
+			: LineRenderMode::Stencil;
+	}
+
 	bool Init() {
 		if (!InitGL()
 			|| !whiteSquare.Init()
@@ -228,6 +541,10 @@ public:
 
 		CreateShaders();
 
+		ObjectSelection::OnChanged() += [&](const ObjectSelection::Selection&) {
+			shouldUpdateDrawLists = true;
+		};
+
 		return true;
 	}
 };
@@ -1,6 +1,9 @@
 #pragma once
 #include "GLLoader.hpp"
 #include "Settings.hpp"
+#include <cstdint>
+#include <algorithm>
+#include <glm/mat4x4.hpp>
 
 enum ObjectType {
 	Group,
@@ -10,6 +13,31 @@ enum ObjectType {
 	CrossT,
 	TraceObjectT,
 	SineCurveT,
+	GridMeshT,
+};
+
+// Generational handle of a persistent object node.
+// Index addresses a registry slot and generation detects
+// that the slot was released and reused by another node.
+struct ObjectHandle {
+	static const uint32_t InvalidIndex = UINT32_MAX;
+
+	uint32_t index = InvalidIndex;
+	uint32_t generation = 0;
+
+	bool IsValid() const {
+		return index != InvalidIndex;
+	}
+
+	bool operator==(const ObjectHandle& o) const {
+		return index == o.index && generation == o.generation;
+	}
+	bool operator!=(const ObjectHandle& o) const {
+		return !(*this == o);
+	}
+	bool operator<(const ObjectHandle& o) const {
+		return index < o.index || index == o.index && generation < o.generation;
+	}
 };
 
 enum InsertPosition {
@@ -27,10 +55,17 @@ class SceneObject {
 	// Local rotation;
 	glm::fquat rotation = unitQuat();
 	SceneObject* parent = nullptr;
+
+	// Handle of the persistent node that owns the object.
+	// Assigned by PON and never copied to clones.
+	ObjectHandle handle;
+	friend class PON;
 protected:
 	bool shouldTransformPosition = false;
 	bool shouldTransformRotation = false;
-	GLuint VBOLeft, VBORight, VAO;
+	GLuint VBOLeft, VBORight;
+	// Configured once to read positions from VBOLeft and VBORight.
+	GLuint VAOLeft, VAORight;
 
 	static bool& isAnyObjectUpdated() {
 		static bool v;
@@ -44,8 +79,68 @@ protected:
 	// When true cache will be updated on reading.
 	// Means the object was changed.
 	bool shouldUpdateCache = true;
+
+	// Global counter that orders all transform changes.
+	static uint64_t& transformGenerationCounter() {
+		static uint64_t v = 0;
+		return v;
+	}
+	// Generation of the last change of the object's own transform.
+	uint64_t transformGeneration = 0;
+	// Effective transform generation the cache was built for.
+	uint64_t cachedTransformGeneration = 0;
+	// Result of the last GetTransformGeneration call.
+	// Valid until any transform or the hierarchy changes.
+	mutable uint64_t effectiveTransformGeneration = 0;
+	mutable uint64_t effectiveTransformCounter = UINT64_MAX;
+	mutable size_t effectiveHierarchyVersion = 0;
+
+	// The latest transform generation among the object and its ancestors.
+	// Parent changes are picked up lazily when the object is read
+	// instead of being pushed to every descendant.
+	// The walk stops at the first ancestor already checked since the last change
+	// so drawing a whole subtree is linear in its size.
+	uint64_t GetTransformGeneration() const {
+		if (effectiveTransformCounter == transformGenerationCounter()
+			&& effectiveHierarchyVersion == HierarchyVersion())
+			return effectiveTransformGeneration;
+
+		auto v = transformGeneration;
+		if (parent)
+			if (auto p = parent->GetTransformGeneration(); p > v)
+				v = p;
+
+		effectiveTransformGeneration = v;
+		effectiveTransformCounter = transformGenerationCounter();
+		effectiveHierarchyVersion = HierarchyVersion();
+		return v;
+	}
+	bool ShouldUpdateCache() const {
+		return shouldUpdateCache || cachedTransformGeneration != GetTransformGeneration();
+	}
+	void MarkCacheUpdated() {
+		shouldUpdateCache = false;
+		cachedTransformGeneration = GetTransformGeneration();
+	}
 	const float propertyIndent = -20;
 
+	// Objects whose HandleBeforeUpdate must run when an ancestor changes.
+	// ForceUpdateCache doesn't visit descendants so it notifies them from here.
+	static std::vector<SceneObject*>& ancestorChangeListeners() {
+		static std::vector<SceneObject*> v;
+		return v;
+	}
+	void ListenToAncestorChanges() {
+		ancestorChangeListeners().push_back(this);
+	}
+	bool IsAncestorOf(const SceneObject* o) const {
+		for (auto p = o->parent; p; p = p->parent)
+			if (p == this)
+				return true;
+
+		return false;
+	}
+
 	virtual void HandleBeforeUpdate() {
 		if (!isAnyObjectUpdated()) {
 			isAnyObjectUpdated() = true;
@@ -106,9 +201,24 @@ public:
 		return onBeforeAnyElementChanged();
 	}
 
+	// Incremented whenever the object hierarchy changes.
+	// Lets views cache data derived from the tree.
+	static size_t& HierarchyVersion() {
+		static size_t v = 0;
+		return v;
+	}
+
 	SceneObject() {
 		glGenBuffers(2, &VBOLeft);
-		glGenVertexArrays(1, &VAO);
+		glGenVertexArrays(2, &VAOLeft);
+
+		for (auto [vao, vbo] : { std::make_pair(VAOLeft, VBOLeft), std::make_pair(VAORight, VBORight) }) {
+			GLState::BindVertexArray(vao);
+			GLState::BindBuffer(GL_ARRAY_BUFFER, vbo);
+			glVertexAttribPointer(GL_POINTS, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+			glEnableVertexAttribArray(GL_POINTS);
+		}
+		GLState::BindVertexArray(0);
 	}
 	SceneObject(const SceneObject* copy) : SceneObject() {
 		position = copy->position;
@@ -118,8 +228,11 @@ public:
 		Name = copy->Name;
 	}
 	~SceneObject() {
-		glDeleteBuffers(2, &VBOLeft);
-		glDeleteVertexArrays(1, &VAO);
+		auto& listeners = ancestorChangeListeners();
+		listeners.erase(std::remove(listeners.begin(), listeners.end(), this), listeners.end());
+
+		GLState::DeleteBuffers(2, &VBOLeft);
+		GLState::DeleteVertexArrays(2, &VAOLeft);
 	}
 
 	virtual void Draw(
@@ -129,20 +242,66 @@ public:
 		GLuint shaderRight,
 		GLuint stencilMaskLeft,
 		GLuint stencilMaskRight) {
-		if (shouldUpdateCache || Settings::ShouldDetectPosition().Get())
-			UpdateOpenGLBuffer(toLeft, toRight);
+		UpdateBuffers(toLeft, toRight);
 
-		glStencilMask(stencilMaskLeft);
-		glStencilFunc(GL_ALWAYS, stencilMaskLeft, stencilMaskLeft | stencilMaskRight);
-		glStencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE);
+		GLState::StencilMask(stencilMaskLeft);
+		GLState::StencilFunc(GL_ALWAYS, stencilMaskLeft, stencilMaskLeft | stencilMaskRight);
+		GLState::StencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE);
 		DrawLeft(shaderLeft);
 
-		glStencilMask(stencilMaskRight);
-		glStencilFunc(GL_ALWAYS, stencilMaskRight, stencilMaskLeft | stencilMaskRight);
-		glStencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE);
+		GLState::StencilMask(stencilMaskRight);
+		GLState::StencilFunc(GL_ALWAYS, stencilMaskRight, stencilMaskLeft | stencilMaskRight);
+		GLState::StencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE);
 		DrawRight(shaderRight);
 	}
 
+	// Projections are recalculated only when the object or the camera changed
+	// and are shared by all output modes.
+	void UpdateBuffers(
+		std::function<glm::vec3(glm::vec3)> toLeft,
+		std::function<glm::vec3(glm::vec3)> toRight) {
+		if (ShouldUpdateCache() || Settings::ShouldDetectPosition().Get())
+			UpdateOpenGLBuffer(toLeft, toRight);
+	}
+	// Draws one eye's projection to its own target without stencil marks.
+	void DrawEye(bool isLeft, GLuint shader) {
+		if (isLeft)
+			DrawLeft(shader);
+		else
+			DrawRight(shader);
+	}
+
+	// Objects drawn from their local vertices as a line strip
+	// can be drawn as instances of geometry shared with their clones.
+	virtual bool IsInstanceable() const {
+		return false;
+	}
+	// Instances are projected by the vertex shader so their buffers aren't updated.
+	// Returns true if the object changed since the last call.
+	bool MarkInstanceUpdated() {
+		if (!ShouldUpdateCache())
+			return false;
+
+		MarkCacheUpdated();
+		return true;
+	}
+	// Maps local vertices to world ones.
+	// Objects are only rotated and moved so the mapping is affine.
+	glm::mat4 GetWorldTransform() const {
+		std::vector<glm::vec3> basis = { glm::vec3(0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1) };
+		CascadeTransform(basis);
+
+		return glm::mat4(
+			glm::vec4(basis[1] - basis[0], 0),
+			glm::vec4(basis[2] - basis[0], 0),
+			glm::vec4(basis[3] - basis[0], 0),
+			glm::vec4(basis[0], 1));
+	}
+
+
+	const ObjectHandle& GetHandle() const {
+		return handle;
+	}
 
 	constexpr const glm::fquat unitQuat() const {
 		return glm::fquat(1, 0, 0, 0);
@@ -153,6 +312,7 @@ public:
 	}
 	void SetParent(SceneObject* newParent, int newParentPos, InsertPosition pos) {
 		ForceUpdateCache();
+		HierarchyVersion()++;
 		auto source = &parent->children;
 		auto dest = &newParent->children;
 
@@ -198,6 +358,7 @@ public:
 		bool shouldUpdateNewParent = true) {
 		if (shouldForceUpdateCache)
 			ForceUpdateCache();
+		HierarchyVersion()++;
 
 		if (!shouldIgnoreOldParent && parent && parent->children.size() > 0) {
 			auto pos = std::find(parent->children.begin(), parent->children.end(), this);
@@ -286,12 +447,19 @@ public:
 	}
 
 	// Forces the object and all children to update cache.
+	// Children compare generations when they are drawn
+	// so only the descendants listening to ancestor changes are visited.
 	void ForceUpdateCache() {
 		HandleBeforeUpdate();
 
 		shouldUpdateCache = true;
-		for (auto c : children)
-			c->ForceUpdateCache();
+		transformGeneration = ++transformGenerationCounter();
+
+		// Indexed since handlers may create objects.
+		auto& listeners = ancestorChangeListeners();
+		for (size_t i = 0; i < listeners.size(); i++)
+			if (IsAncestorOf(listeners[i]))
+				listeners[i]->HandleBeforeUpdate();
 	}
 
 
@@ -375,12 +543,66 @@ class PON {
 	struct Node {
 		SceneObject* object = nullptr;
 		int referenceCount = 0;
+		ObjectHandle handle;
+		// Set while the object is stored in Scene::Objects.
+		bool isInScene = false;
+		// Set while the object is in ObjectSelection.
+		bool isSelected = false;
+	};
+	struct Slot {
+		Node* node = nullptr;
+		uint32_t generation = 0;
 	};
 	Node* node = nullptr;
-	static std::map<SceneObject*, Node*>& existingNodes() {
-		static std::map<SceneObject*, Node*> v;
+
+	// Slot map of all existing nodes.
+	// Provides O(1) insert, remove and lookup by handle.
+	static std::vector<Slot>& slots() {
+		static std::vector<Slot> v;
 		return v;
 	}
+	static std::vector<uint32_t>& freeSlots() {
+		static std::vector<uint32_t> v;
+		return v;
+	}
+
+	static void Register(Node* n) {
+		uint32_t index;
+		if (freeSlots().empty()) {
+			index = slots().size();
+			slots().push_back(Slot());
+		}
+		else {
+			index = freeSlots().back();
+			freeSlots().pop_back();
+		}
+
+		slots()[index].node = n;
+		n->handle.index = index;
+		n->handle.generation = slots()[index].generation;
+	}
+	static void Unregister(Node* n) {
+		if (!n->handle.IsValid())
+			return;
+
+		auto& slot = slots()[n->handle.index];
+		slot.node = nullptr;
+		// Invalidates all handles that reference this slot.
+		slot.generation++;
+		freeSlots().push_back(n->handle.index);
+
+		n->handle = ObjectHandle();
+	}
+	static Node* Find(const ObjectHandle& h) {
+		if (!h.IsValid() || h.index >= slots().size())
+			return nullptr;
+
+		auto& slot = slots()[h.index];
+		return slot.generation == h.generation
+			? slot.node
+			: nullptr;
+	}
+
 	constexpr void Init(const PON& o) {
 		node = o.node;
 		if (node)
@@ -394,18 +616,30 @@ public:
 		Init(o);
 	}
 	PON(SceneObject* o) {
-		if (auto n = existingNodes().find(o);
-			n != existingNodes().end()) {
-			node = n->second;
+		// Null objects aren't registered.
+		if (!o) {
+			node = nullptr;
+			return;
 		}
-		else {
-			node = new Node();
-			existingNodes()[o] = node;
+
+		node = Find(o->handle);
+
+		// The object doesn't have a node yet 
+		// or its handle belongs to a released node.
+		if (!node || node->object != o) {
+			node = nullptr;
 			Set(o);
 		}
 
 		node->referenceCount++;
 	}
+	// Looks up the node registered under the handle.
+	// Results in an empty PON if the node was released.
+	explicit PON(const ObjectHandle& h) {
+		node = Find(h);
+		if (node)
+			node->referenceCount++;
+	}
 	~PON() {
 		if (!node)
 			return;
@@ -414,7 +648,7 @@ public:
 		if (node->referenceCount > 0)
 			return;
 
-		existingNodes().erase(node->object);
+		Unregister(node);
 		Delete();
 		delete node;
 	}
@@ -430,16 +664,17 @@ public:
 		return node->object;
 	}
 	void Set(SceneObject* o) {
-		if (node) {
-			if (node->object)
-				existingNodes().erase(node->object);
+		if (node)
 			Delete();
-		}
 		else
 			node = new Node();
 
+		if (!node->handle.IsValid())
+			Register(node);
+
 		node->object = o;
-		existingNodes()[o] = node;
+		if (o)
+			o->handle = node->handle;
 	}
 	void Delete() {
 		if (!node->object)
@@ -449,6 +684,28 @@ public:
 		node->object = nullptr;
 	}
 
+	ObjectHandle GetHandle() const {
+		return node
+			? node->handle
+			: ObjectHandle();
+	}
+
+	bool IsInScene() const {
+		return node && node->isInScene;
+	}
+	void SetInScene(bool v) const {
+		if (node)
+			node->isInScene = v;
+	}
+
+	bool IsSelected() const {
+		return node && node->isSelected;
+	}
+	void SetSelected(bool v) const {
+		if (node)
+			node->isSelected = v;
+	}
+
 	SceneObject* operator->() {
 		return Get();
 	}
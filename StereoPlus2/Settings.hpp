@@ -77,6 +77,42 @@ public:
 
 	StaticProperty(bool, ShouldMoveCrossOnSinePenModeChange)
 
+	// Empty for the camera, .csv file for a recorded trajectory,
+	// otherwise a video file or an image sequence.
+	StaticProperty(std::string, PositionDetectionSource)
+	// Detected positions are recorded to the file when not empty.
+	StaticProperty(std::string, PositionRecordFileName)
+	// haar, lbp or dnn.
+	StaticProperty(std::string, PositionDetectorBackend)
+	// Drive camera's eye to center distance by the measured distance between eyes.
+	StaticProperty(bool, ShouldDetectEyes)
+	// Produce frames only when something changed instead of every vsync.
+	StaticProperty(bool, ShouldRenderOnDemand)
+	// maximum or adaptive.
+	StaticProperty(std::string, TrackerRatePolicy)
+	// Render frame budget of the adaptive tracker rate.
+	StaticProperty(int, TargetFrameRate)
+	// Keep tracking and rendering threads on different cores.
+	StaticProperty(bool, ShouldPinThreads)
+	// Pixels. Size of the image rendered by Render advanced.
+	StaticProperty(int, AdvancedRenderWidth)
+	StaticProperty(int, AdvancedRenderHeight)
+	// png or tiff.
+	StaticProperty(std::string, AdvancedRenderFormat)
+	// Camera path of the sequence export in the trajectory format.
+	StaticProperty(std::string, SequenceExportPath)
+	StaticProperty(int, SequenceExportFrameRate)
+	// png for numbered images or video for an ffmpeg encoded video.
+	StaticProperty(std::string, SequenceExportTarget)
+	// stencil or smooth.
+	StaticProperty(std::string, LineRenderMode)
+	// Pixels.
+	StaticProperty(float, LineThickness)
+	// Pixels. Largest deviation of simplified lines from the original, 0 draws full detail.
+	StaticProperty(float, LevelOfDetailError)
+	// anaglyph, sideBySide, topBottom, interlaced or dualWindow.
+	StaticProperty(std::string, StereoOutputMode)
+
 
 	static const std::string& Name(void* reference) {
 		static std::map<void*, const std::string> v = {
@@ -101,6 +137,25 @@ public:
 			{&CustomRenderWindowAlpha,"customRenderWindowAlpha"},
 
 			{&ShouldMoveCrossOnSinePenModeChange,"shouldMoveCrossOnSinePenModeChange"},
+
+			{&PositionDetectionSource,"positionDetectionSource"},
+			{&PositionRecordFileName,"positionRecordFileName"},
+			{&PositionDetectorBackend,"positionDetectorBackend"},
+			{&ShouldDetectEyes,"shouldDetectEyes"},
+			{&ShouldRenderOnDemand,"shouldRenderOnDemand"},
+			{&TrackerRatePolicy,"trackerRatePolicy"},
+			{&TargetFrameRate,"targetFrameRate"},
+			{&ShouldPinThreads,"shouldPinThreads"},
+			{&AdvancedRenderWidth,"advancedRenderWidth"},
+			{&AdvancedRenderHeight,"advancedRenderHeight"},
+			{&AdvancedRenderFormat,"advancedRenderFormat"},
+			{&SequenceExportPath,"sequenceExportPath"},
+			{&SequenceExportFrameRate,"sequenceExportFrameRate"},
+			{&SequenceExportTarget,"sequenceExportTarget"},
+			{&LineRenderMode,"lineRenderMode"},
+			{&LineThickness,"lineThickness"},
+			{&LevelOfDetailError,"levelOfDetailError"},
+			{&StereoOutputMode,"stereoOutputMode"},
 		};
 
 		if (auto a = v.find(reference); a != v.end())
@@ -155,6 +155,25 @@ public:
 		Load(&Settings::CustomRenderWindowAlpha);
 
 		Load(&Settings::ShouldMoveCrossOnSinePenModeChange);
+
+		Load(&Settings::PositionDetectionSource);
+		Load(&Settings::PositionRecordFileName);
+		Load(&Settings::PositionDetectorBackend);
+		Load(&Settings::ShouldDetectEyes);
+		Load(&Settings::ShouldRenderOnDemand);
+		Load(&Settings::TrackerRatePolicy);
+		Load(&Settings::TargetFrameRate);
+		Load(&Settings::ShouldPinThreads);
+		Load(&Settings::AdvancedRenderWidth);
+		Load(&Settings::AdvancedRenderHeight);
+		Load(&Settings::AdvancedRenderFormat);
+		Load(&Settings::SequenceExportPath);
+		Load(&Settings::SequenceExportFrameRate);
+		Load(&Settings::SequenceExportTarget);
+		Load(&Settings::LineRenderMode);
+		Load(&Settings::LineThickness);
+		Load(&Settings::LevelOfDetailError);
+		Load(&Settings::StereoOutputMode);
 	}
 	static void Save() {
 		Js::Object json;
@@ -178,6 +197,25 @@ public:
 
 		Insert(json, &Settings::ShouldMoveCrossOnSinePenModeChange);
 
+		Insert(json, &Settings::PositionDetectionSource);
+		Insert(json, &Settings::PositionRecordFileName);
+		Insert(json, &Settings::PositionDetectorBackend);
+		Insert(json, &Settings::ShouldDetectEyes);
+		Insert(json, &Settings::ShouldRenderOnDemand);
+		Insert(json, &Settings::TrackerRatePolicy);
+		Insert(json, &Settings::TargetFrameRate);
+		Insert(json, &Settings::ShouldPinThreads);
+		Insert(json, &Settings::AdvancedRenderWidth);
+		Insert(json, &Settings::AdvancedRenderHeight);
+		Insert(json, &Settings::AdvancedRenderFormat);
+		Insert(json, &Settings::SequenceExportPath);
+		Insert(json, &Settings::SequenceExportFrameRate);
+		Insert(json, &Settings::SequenceExportTarget);
+		Insert(json, &Settings::LineRenderMode);
+		Insert(json, &Settings::LineThickness);
+		Insert(json, &Settings::LevelOfDetailError);
+		Insert(json, &Settings::StereoOutputMode);
+
 		Json::Write("settings.json", &json);
 	}
 };
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "GLLoader.hpp"
+#include "InfrastructureTypes.hpp"
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// Builds programs from the files in shaders/ and rebuilds them when the files change.
+// Linked binaries are cached in memory and on disk by the hash of their sources,
+// so the programs whose sources didn't change are never compiled again.
+class ShaderManager {
+	struct Entry {
+		// The owner's variable is replaced with the rebuilt program.
+		GLuint* program;
+		std::vector<std::string> paths;
+		std::vector<fs::file_time_type> writeTimes;
+		// Of the sources the program was built from.
+		std::string hash;
+	};
+
+	struct Binary {
+		GLenum format;
+		std::vector<char> data;
+	};
+
+	static std::vector<Entry>& entries() {
+		static std::vector<Entry> v;
+		return v;
+	}
+	static std::map<std::string, Binary>& binaries() {
+		static std::map<std::string, Binary> v;
+		return v;
+	}
+	static std::chrono::steady_clock::time_point& lastCheck() {
+		static std::chrono::steady_clock::time_point v;
+		return v;
+	}
+
+	static constexpr std::chrono::milliseconds checkInterval = std::chrono::milliseconds(500);
+
+	// Program binaries are core since GL 4.1, older contexts may lack the entry points
+	// or report no binary formats. Programs are always compiled then.
+	static bool isBinaryCacheSupported() {
+		static int v = -1;
+		if (v == -1) {
+			GLint formatCount = 0;
+			if (glProgramBinary && glGetProgramBinary && glProgramParameteri)
+				glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+
+			v = formatCount > 0;
+			if (!v)
+				Log::For<ShaderManager>().Information("Program binaries aren't supported, shaders aren't cached");
+		}
+		return v;
+	}
+
+	static GLenum getStage(const std::string& path) {
+		auto extension = fs::path(path).extension().string();
+		if (extension == ".vert")
+			return GL_VERTEX_SHADER;
+		if (extension == ".geom")
+			return GL_GEOMETRY_SHADER;
+		return GL_FRAGMENT_SHADER;
+	}
+
+	static std::vector<fs::file_time_type> getWriteTimes(const std::vector<std::string>& paths) {
+		std::vector<fs::file_time_type> times;
+		for (auto& path : paths) {
+			std::error_code error;
+			times.push_back(fs::last_write_time(path, error));
+		}
+		return times;
+	}
+
+	// Binaries are valid only for the driver that produced them.
+	static std::string getHash(const std::vector<std::string>& sources) {
+		std::string key;
+		for (auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+			if (auto v = glGetString(name))
+				key += (const char*)v;
+
+		for (auto& source : sources)
+			key += '\0' + source;
+
+		std::stringstream ss;
+		ss << std::hex << std::hash<std::string>()(key);
+		return ss.str();
+	}
+
+	static fs::path getCachePath(const std::string& hash) {
+		return fs::path(CacheDirectory()) / (hash + ".bin");
+	}
+
+	static bool loadBinary(GLuint program, const std::string& hash) {
+		if (!isBinaryCacheSupported())
+			return false;
+
+		auto binary = binaries().find(hash);
+		if (binary == binaries().end()) {
+			std::ifstream in(getCachePath(hash), std::ios::binary);
+			if (!in)
+				return false;
+
+			Binary v;
+			if (!in.read((char*)&v.format, sizeof(v.format)))
+				return false;
+			v.data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+			if (v.data.empty())
+				return false;
+
+			binary = binaries().insert({ hash, std::move(v) }).first;
+		}
+
+		glProgramBinary(program, binary->second.format, binary->second.data.data(), (GLsizei)binary->second.data.size());
+
+		int success;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		// Drivers reject binaries after an update, the program is compiled again then.
+		if (!success)
+			binaries().erase(binary);
+
+		return success;
+	}
+
+	static void saveBinary(GLuint program, const std::string& hash) {
+		if (!isBinaryCacheSupported())
+			return;
+
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+
+		Binary v;
+		v.data.resize(length);
+		glGetProgramBinary(program, length, NULL, &v.format, v.data.data());
+
+		std::error_code error;
+		fs::create_directories(CacheDirectory(), error);
+		std::ofstream out(getCachePath(hash), std::ios::binary);
+		if (out) {
+			out.write((const char*)&v.format, sizeof(v.format));
+			out.write(v.data.data(), v.data.size());
+		}
+		else
+			Log::For<ShaderManager>().Warning("Failed to write shader cache ", getCachePath(hash).string());
+
+		binaries()[hash] = std::move(v);
+	}
+
+	static bool isHashUsed(const std::string& hash) {
+		for (auto& entry : entries())
+			if (entry.hash == hash)
+				return true;
+		return false;
+	}
+	static void removeBinary(const std::string& hash) {
+		binaries().erase(hash);
+
+		std::error_code error;
+		fs::remove(getCachePath(hash), error);
+	}
+
+	// Returns 0 if any of the shaders doesn't compile or the program doesn't link.
+	static GLuint build(const std::vector<std::string>& paths, std::string& hash) {
+		std::vector<std::string> sources;
+		std::string name;
+		for (auto& path : paths) {
+			sources.push_back(GLLoader::ReadShader(path));
+			name += (name.empty() ? "" : ", ") + path;
+		}
+
+		hash = getHash(sources);
+		GLuint program = glCreateProgram();
+		if (loadBinary(program, hash))
+			return program;
+
+		std::vector<GLuint> shaders;
+		for (size_t i = 0; i < paths.size(); i++)
+			if (auto shader = GLLoader::CompileShader(getStage(paths[i]), sources[i].c_str(), paths[i]))
+				shaders.push_back(shader);
+			else {
+				for (auto shader : shaders)
+					glDeleteShader(shader);
+				glDeleteProgram(program);
+				return 0;
+			}
+
+		if (isBinaryCacheSupported())
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		if (!GLLoader::LinkProgram(program, shaders, name)) {
+			glDeleteProgram(program);
+			return 0;
+		}
+
+		saveBinary(program, hash);
+		return program;
+	}
+
+public:
+	StaticFieldDefault(std::string, CacheDirectory, "shaderCache")
+
+	// Paths are relative to the working directory, the stage is taken from the extension:
+	// .vert, .geom or a fragment shader otherwise.
+	// The program is replaced by the rebuilt one later so it must live as long as the context.
+	static bool Load(GLuint& program, const std::vector<std::string>& paths) {
+		std::string hash;
+		program = build(paths, hash);
+		entries().push_back({ &program, paths, getWriteTimes(paths), hash });
+
+		return program != 0;
+	}
+
+	// Removes cached binaries no loaded program is built from,
+	// e.g. of shaders edited since or of another driver. Called once all programs are loaded.
+	static void PruneCache() {
+		std::vector<std::string> stale;
+		std::error_code error;
+		for (auto& file : fs::directory_iterator(CacheDirectory(), error))
+			if (file.path().extension() == ".bin" && !isHashUsed(file.path().stem().string()))
+				stale.push_back(file.path().stem().string());
+
+		for (auto& hash : stale)
+			removeBinary(hash);
+	}
+
+	// Rebuilds programs whose files were saved since the last check.
+	// A program that fails to build is kept until its files change again.
+	// Returns true if any program was replaced so the caller can set its uniforms again.
+	static bool CheckForChanges() {
+		auto now = std::chrono::steady_clock::now();
+		if (now - lastCheck() < checkInterval)
+			return false;
+		lastCheck() = now;
+
+		bool isReplaced = false;
+		for (auto& entry : entries()) {
+			auto writeTimes = getWriteTimes(entry.paths);
+			if (writeTimes == entry.writeTimes)
+				continue;
+			entry.writeTimes = writeTimes;
+
+			std::string hash;
+			auto program = build(entry.paths, hash);
+			if (!program)
+				continue;
+
+			auto oldHash = entry.hash;
+			entry.hash = hash;
+			if (oldHash != hash && !isHashUsed(oldHash))
+				removeBinary(oldHash);
+
+			if (*entry.program)
+				GLState::DeleteProgram(*entry.program);
+			*entry.program = program;
+			isReplaced = true;
+
+			Log::For<ShaderManager>().Information("Reloaded ", entry.paths.back());
+		}
+
+		return isReplaced;
+	}
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "GLLoader.hpp"
+#include <glm/vec2.hpp>
+#include <string>
+
+
+enum class StereoOutputMode {
+	// Red/cyan image.
+	Anaglyph,
+	// Eyes squeezed to the left and right halves of the view.
+	SideBySide,
+	// Left eye on the top half, right eye on the bottom one.
+	TopBottom,
+	// Even rows from the left eye, odd rows from the right one.
+	Interlaced,
+	// Each eye in its own window, e.g. for a pair of projectors.
+	DualWindow,
+};
+
+// Color target one eye is rendered to before composition.
+struct EyeTarget {
+	GLuint fbo = 0;
+	GLuint texture = 0;
+	glm::ivec2 size = glm::ivec2(0);
+
+	// Storage is reallocated only when the size changes.
+	// Leaves the target's framebuffer bound.
+	void Resize(const glm::ivec2& newSize) {
+		if (fbo == 0) {
+			glGenFramebuffers(1, &fbo);
+			glGenTextures(1, &texture);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+		if (newSize == size)
+			return;
+		size = newSize;
+
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	}
+
+	void Delete() {
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteTextures(1, &texture);
+		fbo = texture = 0;
+		size = glm::ivec2(0);
+	}
+};
+
+// Window showing one eye's image.
+// Its context shares objects with the main one so eye textures are read directly.
+class EyeWindow {
+	const Log log = Log::For<EyeWindow>();
+
+	GLFWwindow* window = nullptr;
+	// Framebuffers aren't shared between contexts so the window reads through its own one.
+	GLuint readFramebuffer = 0;
+	GLuint attachedTexture = 0;
+
+public:
+	bool Open(GLFWwindow* sharedWindow, const char* title) {
+		if (window)
+			return true;
+
+		// Projectors must not show the desktop through the image.
+		glfwWindowHint(GLFW_TRANSPARENT_FRAMEBUFFER, false);
+		window = glfwCreateWindow(1280, 720, title, NULL, sharedWindow);
+		glfwWindowHint(GLFW_TRANSPARENT_FRAMEBUFFER, true);
+
+		if (!window) {
+			log.Error("Failed to create ", title, " window");
+			return false;
+		}
+
+		auto current = glfwGetCurrentContext();
+		glfwMakeContextCurrent(window);
+		// The main window already waits for vsync.
+		glfwSwapInterval(0);
+		glGenFramebuffers(1, &readFramebuffer);
+		glfwMakeContextCurrent(current);
+
+		return true;
+	}
+
+	bool IsOpen() const {
+		return window != nullptr;
+	}
+	bool ShouldClose() const {
+		return window && glfwWindowShouldClose(window);
+	}
+
+	// Fits the texture into the window keeping its aspect ratio.
+	void Present(GLuint texture, const glm::ivec2& size) {
+		if (!window)
+			return;
+
+		// Commands of the main context must reach the texture before it is read by another one.
+		glFlush();
+
+		auto current = glfwGetCurrentContext();
+		glfwMakeContextCurrent(window);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+		if (attachedTexture != texture) {
+			glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+			attachedTexture = texture;
+		}
+
+		int width, height;
+		glfwGetFramebufferSize(window, &width, &height);
+
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glViewport(0, 0, width, height);
+		glClearColor(0, 0, 0, 1);
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		if (size.x > 0 && size.y > 0) {
+			auto scaleX = width / (float)size.x;
+			auto scaleY = height / (float)size.y;
+			auto scale = scaleX < scaleY ? scaleX : scaleY;
+			auto fitted = glm::ivec2(glm::vec2(size) * scale);
+			auto offset = (glm::ivec2(width, height) - fitted) / 2;
+
+			// The scene is rendered with y negated and the scene view shows the texture
+			// with its first row on top, so the blit is flipped to show it the same way.
+			glBlitFramebuffer(
+				0, 0, size.x, size.y,
+				offset.x, offset.y + fitted.y, offset.x + fitted.x, offset.y,
+				GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		}
+
+		glfwSwapBuffers(window);
+		glfwMakeContextCurrent(current);
+	}
+
+	void Close() {
+		if (!window)
+			return;
+
+		auto current = glfwGetCurrentContext();
+		glfwMakeContextCurrent(window);
+		glDeleteFramebuffers(1, &readFramebuffer);
+		glfwMakeContextCurrent(current);
+
+		glfwDestroyWindow(window);
+		window = nullptr;
+		readFramebuffer = attachedTexture = 0;
+	}
+};
@@ -330,10 +330,9 @@ class PenTool : public EditingTool {
 
 				auto cmd = new CreateCommand();
 
-				if (ObjectSelection::Selected().size() == 1) {
-					auto d = ObjectSelection::Selected().begin()._Ptr->_Myval.Get();
-					cmd->destination = d->GetParent() ? const_cast<SceneObject*>(d->GetParent()) : d;
-				}
+				if (ObjectSelection::Selected().size() == 1)
+					if (PON d(*ObjectSelection::Selected().begin()); d.HasValue())
+						cmd->destination = d->GetParent() ? const_cast<SceneObject*>(d->GetParent()) : d.Get();
 
 				cmd->init = [] {
 					auto o = new PolyLine();
@@ -352,11 +351,11 @@ class PenTool : public EditingTool {
 			});
 	}
 
-	ObjectSelection::Selection GetExistingObjects(const ObjectSelection::Selection& v) {
-		ObjectSelection::Selection ns;
-		for (auto& o : Scene::Objects().Get())
-			if (v.find(o) != v.end())
-				ns.insert(o);
+	std::vector<PON> GetExistingObjects(const ObjectSelection::Selection& v) {
+		std::vector<PON> ns;
+		for (auto& h : v)
+			if (PON o(h); o.IsInScene())
+				ns.push_back(o);
 
 		return ns;
 	}
@@ -377,7 +376,7 @@ class PenTool : public EditingTool {
 			return;
 		}
 
-		auto t = targets.begin()._Ptr->_Myval;
+		auto t = targets.front();
 
 		if (t->GetType() != PolyLineT)
 			return TryCreateNewObject();
@@ -403,7 +402,7 @@ class PenTool : public EditingTool {
 				return;
 			}
 
-			if (!exists(Scene::Objects().Get(), target)) {
+			if (!target.IsInScene()) {
 				target = PON();
 				return;
 			}
@@ -522,7 +521,7 @@ public:
 };
 
 template<ObjectType type>
-class ExtrusionEditingTool : public EditingToolConfigured<ExtrusionEditingToolMode>, public CreatingTool<Mesh> {
+class ExtrusionEditingTool : public EditingToolConfigured<ExtrusionEditingToolMode>, public CreatingTool<GridMesh> {
 #pragma region Types
 	template<ObjectType type, Mode mode>
 	struct Config : EditingToolConfigured::Config {
@@ -600,22 +599,16 @@ class ExtrusionEditingTool : public EditingToolConfigured<ExtrusionEditingToolMo
 			return;
 		}
 
-		auto& meshPoints = mesh->GetVertices();
 		auto& penPoints = pen->GetVertices();
 		auto transformVector = GetPos() - crossStartPosition;
-		auto mesh = (Mesh*)this->mesh.Get();
+		auto mesh = (GridMesh*)this->mesh.Get();
 
 		if (GetConfig<Mode::Immediate>()->directingPoints.size() < 1) {
 			// We need to select one point and create an additional point
 			// so that we can perform some optimizations.
 			GetConfig<Mode::Immediate>()->directingPoints.push_back(GetPos());
 
-			mesh->AddVertice(penPoints[0] + transformVector);
-
-			for (size_t i = 1; i < penPoints.size(); i++) {
-				mesh->AddVertice(penPoints[i] + transformVector);
-				mesh->Connect(i - 1, i);
-			}
+			mesh->AppendExtrusionRing(penPoints, transformVector);
 
 			return;
 		}
@@ -624,16 +617,7 @@ class ExtrusionEditingTool : public EditingToolConfigured<ExtrusionEditingToolMo
 			// so that we can perform some optimizations.
 			GetConfig<Mode::Immediate>()->directingPoints.push_back(GetPos());
 
-			auto meshPointsSize = meshPoints.size();
-			mesh->AddVertice(penPoints[0] + transformVector);
-			mesh->Connect(meshPointsSize - penPoints.size(), meshPointsSize);
-
-			for (size_t i = 1; i < penPoints.size(); i++) {
-				meshPointsSize = meshPoints.size();
-				mesh->AddVertice(penPoints[i] + transformVector);
-				mesh->Connect(meshPointsSize - penPoints.size(), meshPointsSize);
-				mesh->Connect(meshPointsSize - 1, meshPointsSize);
-			}
+			mesh->AppendExtrusionRing(penPoints, transformVector);
 
 			return;
 		}
@@ -653,22 +637,12 @@ class ExtrusionEditingTool : public EditingToolConfigured<ExtrusionEditingToolMo
 		auto cos = p / l1 / l2;
 
 		if (abs(cos) > 1 - E || isnan(cos)) {
-			for (size_t i = 0; i < penPoints.size(); i++)
-				mesh->SetVertice(meshPoints.size() - penPoints.size() + i, penPoints[i] + transformVector);
+			mesh->SetLastExtrusionRing(penPoints, transformVector);
 
 			(*directingPoints)[1] = GetPos();
 		}
 		else {
-			auto meshPointsSize = meshPoints.size();
-			mesh->AddVertice(penPoints[0] + transformVector);
-			mesh->Connect(meshPointsSize - penPoints.size(), meshPointsSize);
-
-			for (size_t i = 1; i < penPoints.size(); i++) {
-				meshPointsSize = meshPoints.size();
-				mesh->AddVertice(penPoints[i] + transformVector);
-				mesh->Connect(meshPointsSize - penPoints.size(), meshPointsSize);
-				mesh->Connect(meshPointsSize - 1, meshPointsSize);
-			}
+			mesh->AppendExtrusionRing(penPoints, transformVector);
 
 			directingPoints->erase(directingPoints->begin());
 			directingPoints->push_back(GetPos());
@@ -690,17 +664,12 @@ class ExtrusionEditingTool : public EditingToolConfigured<ExtrusionEditingToolMo
 
 		auto& meshPoints = mesh->GetVertices();
 		auto& penPoints = pen->GetVertices();
-		auto mesh = (Mesh*)this->mesh.Get();
+		auto mesh = (GridMesh*)this->mesh.Get();
 
 		auto transformVector = GetPos() - crossStartPosition;
 
 		if (!GetConfig<Mode::Step>()->isPointCreated || meshPoints.empty()) {
-			mesh->AddVertice(penPoints[0] + transformVector);
-
-			for (size_t i = 1; i < penPoints.size(); i++) {
-				mesh->AddVertice(penPoints[i] + transformVector);
-				mesh->Connect(i - 1, i);
-			}
+			mesh->AppendExtrusionRing(penPoints, transformVector);
 
 			GetConfig<Mode::Step>()->isPointCreated = true;
 
@@ -711,21 +680,11 @@ class ExtrusionEditingTool : public EditingToolConfigured<ExtrusionEditingToolMo
 			isBeingModified() = false;
 			wasCommitDone = false;
 
-			auto s = meshPoints.size();
-			mesh->AddVertice(penPoints[0] + transformVector);
-			mesh->Connect(s - penPoints.size(), s);
-
-			for (size_t i = 1; i < penPoints.size(); i++) {
-				s = meshPoints.size();
-				mesh->AddVertice(penPoints[i] + transformVector);
-				mesh->Connect(s - penPoints.size(), s);
-				mesh->Connect(s - 1, s);
-			}
+			mesh->AppendExtrusionRing(penPoints, transformVector);
 			return;
 		}
 
-		for (size_t i = 0; i < penPoints.size(); i++)
-			mesh->SetVertice(meshPoints.size() - penPoints.size() + i, penPoints[i] + transformVector);
+		mesh->SetLastExtrusionRing(penPoints, transformVector);
 	}
 
 	void ProcessInput() {
@@ -757,33 +716,11 @@ class ExtrusionEditingTool : public EditingToolConfigured<ExtrusionEditingToolMo
 		if (!pen.HasValue())
 			return;
 
-		auto& penPoints = pen->GetVertices();
-		auto mesh = (Mesh*)this->mesh.Get();
-
-		if (GetConfig<Mode::Step>()->isPointCreated && mesh->GetVertices().size() > 0) {
-			if (mesh->GetVertices().size() > penPoints.size())
-			{
-				for (size_t i = 1; i < penPoints.size(); i++)
-				{
-					mesh->RemoveVertice();
-					mesh->Disconnect(mesh->GetVertices().size() - penPoints.size(), mesh->GetVertices().size());
-					mesh->Disconnect(mesh->GetVertices().size() - 1, mesh->GetVertices().size());
-				}
-
-				mesh->RemoveVertice();
-				mesh->Disconnect(mesh->GetVertices().size() - penPoints.size(), mesh->GetVertices().size());
-			}
-			else
-			{
-				for (size_t i = 1; i < penPoints.size(); i++)
-				{
-					mesh->RemoveVertice();
-					mesh->Disconnect(mesh->GetVertices().size() - 1, mesh->GetVertices().size());
-				}
-
-				mesh->RemoveVertice();
-			}
-		}
+		auto mesh = (GridMesh*)this->mesh.Get();
+
+		// The last ring follows the cross and isn't a part of the mesh yet.
+		if (GetConfig<Mode::Step>()->isPointCreated)
+			mesh->RemoveExtrusionRing();
 
 		//this->pen = nullptr;
 	}
@@ -811,7 +748,7 @@ public:
 	NonAssignProperty<Cross*> cross;
 
 	ExtrusionEditingTool() {
-		init = [&, mesh = &mesh](Mesh* o) {
+		init = [&, mesh = &mesh](GridMesh* o) {
 			std::stringstream ss;
 			ss << o->GetDefaultName() << GetId<ExtrusionEditingTool<PolyLineT>>();
 			o->Name = ss.str();
@@ -915,7 +852,7 @@ public:
 
 		DeleteConfig();
 
-		return CreatingTool<Mesh>::Create();
+		return CreatingTool<GridMesh>::Create();
 	};
 };
 
@@ -1086,7 +1023,8 @@ class TransformTool : public EditingTool {
 			return;
 
 		targets.clear();
-		targets.insert(targets.end(), v.begin(), v.end());
+		for (auto& h : v)
+			targets.push_back(PON(h));
 		
 		Input::RemoveHandler(cross->keyboardBindingHandlerId);
 		inputHandlerId = Input::AddHandler([this]{ ProcessInput(type, mode); });
@@ -1284,10 +1222,9 @@ class SinePenTool : public EditingTool {
 
 				auto cmd = new CreateCommand();
 
-				if (ObjectSelection::Selected().size() == 1) {
-					auto d = ObjectSelection::Selected().begin()._Ptr->_Myval.Get();
-					cmd->destination = d->GetParent() ? const_cast<SceneObject*>(d->GetParent()) : d;
-				}
+				if (ObjectSelection::Selected().size() == 1)
+					if (PON d(*ObjectSelection::Selected().begin()); d.HasValue())
+						cmd->destination = d->GetParent() ? const_cast<SceneObject*>(d->GetParent()) : d.Get();
 
 				cmd->init = [] {
 					auto o = new SineCurve();
@@ -1306,11 +1243,11 @@ class SinePenTool : public EditingTool {
 			});
 	}
 
-	ObjectSelection::Selection GetExistingObjects(const ObjectSelection::Selection& v) {
-		ObjectSelection::Selection ns;
-		for (auto& o : Scene::Objects().Get())
-			if (v.find(o) != v.end())
-				ns.insert(o);
+	std::vector<PON> GetExistingObjects(const ObjectSelection::Selection& v) {
+		std::vector<PON> ns;
+		for (auto& h : v)
+			if (PON o(h); o.IsInScene())
+				ns.push_back(o);
 
 		return ns;
 	}
@@ -1331,7 +1268,7 @@ class SinePenTool : public EditingTool {
 			return;
 		}
 
-		auto t = targets.begin()._Ptr->_Myval;
+		auto t = targets.front();
 
 		if (t->GetType() != SineCurveT)
 			return TryCreateNewObject();
@@ -1355,7 +1292,7 @@ class SinePenTool : public EditingTool {
 				return;
 			}
 
-			if (!exists(Scene::Objects().Get(), target)) {
+			if (!target.IsInScene()) {
 				target = PON();
 				return;
 			}
@@ -7,6 +7,7 @@
 #include "Tools.hpp"
 #include "ToolPool.hpp"
 #include <set>
+#include <map>
 #include <sstream>
 #include <string>
 #include "include/imgui/imgui_stdlib.h"
@@ -15,7 +16,12 @@
 #include "InfrastructureTypes.hpp"
 #include "Localization.hpp"
 #include "ImGuiExtensions.hpp"
-#include "include/stb/stb_image_write.h"
+#include "ImageExport.hpp"
+#include "GPUProfiler.hpp"
+#include <deque>
+#include <future>
+#include <iomanip>
+#include <memory>
 
 
 //class TemplateWindow : Window {
@@ -109,44 +115,394 @@ class CustomRenderWindow : Window {
 		RenderSize = newSize;
 	}
 
-	void saveImage(const char* filepath, int width, int height) {
-		GLsizei nrChannels = 3;
-		GLsizei stride = nrChannels * width;
-		stride += (stride % 4) ? (4 - stride % 4) : 0;
-		GLsizei bufferSize = stride * height;
-		std::vector<char> buffer(bufferSize);
-		glPixelStorei(GL_PACK_ALIGNMENT, 4);
-		glReadBuffer(GL_FRONT);
-		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, buffer.data());
+	const Log log = Log::For<CustomRenderWindow>();
+	// Pixels. Tile side of the advanced render.
+	const int tileSize = 1024;
+
+	PixelReadbackQueue readback;
+	ImageEncoder encoder;
+
+	// Pixels are read asynchronously and encoded off the main thread.
+	void saveImage(const std::string& filepath, int width, int height) {
+		readback.Read(fbo, width, height, [&, filepath](Image&& image) {
+			encoder.Encode(std::move(image), filepath);
+		});
+	}
+
+	// Offline render of an image of arbitrary size.
+	// Tiles are rendered to a separate framebuffer a row of tiles per frame
+	// and the rows are streamed to the file so the whole image is never in memory.
+	// The view and object caches stay untouched,
+	// tiles are cut from the projected view by Stereo::TileTransform.
+	struct TiledRender {
+		OffscreenFramebuffer framebuffer;
+
+		std::string fileName;
+		glm::ivec2 outputSize;
+		glm::ivec2 tileSize;
+		int bandCount;
+		int renderedBands = 0;
+		int writtenBands = 0;
+
+		struct Band {
+			std::shared_ptr<std::vector<char>> pixels;
+			int rowCount;
+			int stride;
+		};
+
+		std::shared_ptr<StripedImageWriter> writer;
+		std::future<bool> pendingWrite;
+		// Bands waiting for the previous one to be written.
+		std::deque<Band> queuedBands;
+		bool isFailed = false;
+		std::chrono::steady_clock::time_point started;
+	};
+	std::unique_ptr<TiledRender> tiledRender;
+	// Rendering waits while this many bands are being read back or written.
+	const int maxBandsInFlight = 4;
+
+	static std::unique_ptr<StripedImageWriter> CreateImageWriter(const std::string& format) {
+		if (format == "tiff")
+			return std::make_unique<TiffImageWriter>();
+
+		return std::make_unique<PngImageWriter>();
+	}
+
+	bool StartTiledRender() {
+		auto r = std::make_unique<TiledRender>();
+		r->outputSize = glm::ivec2(Settings::AdvancedRenderWidth().Get(), Settings::AdvancedRenderHeight().Get());
+		r->tileSize = glm::min(r->outputSize, glm::ivec2(tileSize));
+		r->bandCount = (r->outputSize.y + r->tileSize.y - 1) / r->tileSize.y;
+
+		std::stringstream ss;
+		ss << "image_" << Time::GetTime() << "a." << Settings::AdvancedRenderFormat().Get();
+		r->fileName = ss.str();
+
+		r->writer = CreateImageWriter(Settings::AdvancedRenderFormat().Get());
+		if (r->outputSize.x <= 0 || r->outputSize.y <= 0 || !r->writer->Open(r->fileName, r->outputSize.x, r->outputSize.y)) {
+			log.Error("Failed to start tiled render to ", r->fileName);
+			return false;
+		}
+
+		auto isComplete = r->framebuffer.Create(r->tileSize);
+
+		r->started = std::chrono::steady_clock::now();
+		tiledRender = std::move(r);
+
+		if (!isComplete) {
+			log.Error("Tiled render framebuffer is incomplete");
+			tiledRender->isFailed = true;
+			FinishTiledRender();
+			return false;
+		}
+
+		log.Information("Tiled render of ", tiledRender->outputSize.x, "x", tiledRender->outputSize.y, " started");
+		return true;
+	}
+
+	// Rows are written in order. A band waits in the queue for the previous one,
+	// which is polled so the main loop never waits for the disk.
+	// A band counts as written when its write completes.
+	void WriteBands() {
+		auto& r = *tiledRender;
+
+		while (true) {
+			if (r.pendingWrite.valid()) {
+				if (r.pendingWrite.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+					return;
+
+				if (!r.pendingWrite.get())
+					r.isFailed = true;
+				r.writtenBands++;
+			}
+
+			if (r.queuedBands.empty())
+				return;
+
+			auto band = r.queuedBands.front();
+			r.queuedBands.pop_front();
+			r.pendingWrite = std::async(std::launch::async, [writer = r.writer, band] {
+				return writer->Write(band.pixels->data(), band.rowCount, band.stride);
+			});
+		}
+	}
+
+	void RenderTiledBand() {
+		auto& r = *tiledRender;
+
+		auto y = r.renderedBands * r.tileSize.y;
+		auto height = std::min(r.tileSize.y, r.outputSize.y - y);
+		auto stride = Image::GetStride(r.outputSize.x, 3);
+		auto band = std::make_shared<std::vector<char>>((size_t)stride * height);
+		auto tilesLeft = std::make_shared<int>((r.outputSize.x + r.tileSize.x - 1) / r.tileSize.x);
+
+		for (int x = 0; x < r.outputSize.x; x += r.tileSize.x) {
+			auto width = std::min(r.tileSize.x, r.outputSize.x - x);
+
+			Stereo::TileTransform() = Stereo::GetTileTransform(RenderSize.Get(), glm::vec2(r.outputSize), glm::vec2(x, y), glm::vec2(width, height));
+			bindFrameBuffer(r.framebuffer.fbo, width, height);
+			customRenderFunc();
+
+			readback.Read(r.framebuffer.fbo, width, height, [this, band, tilesLeft, x, width, height, stride](Image&& image) {
+				for (int row = 0; row < height; row++)
+					memcpy(band->data() + (size_t)row * stride + (size_t)x * 3, image.pixels.data() + (size_t)row * image.stride, (size_t)width * 3);
+
+				if (--*tilesLeft == 0) {
+					tiledRender->queuedBands.push_back({ band, height, stride });
+					WriteBands();
+				}
+			});
+		}
+
+		Stereo::TileTransform() = glm::vec4(1, 1, 0, 0);
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-		stbi_write_png(filepath, width, height, nrChannels, buffer.data(), stride);
+		r.renderedBands++;
+		log.Information("Tiled render: ", r.renderedBands, " of ", r.bandCount, " rows of tiles rendered");
+	}
+
+	void FinishTiledRender() {
+		auto& r = *tiledRender;
+		// Bands already read back are written when the render is interrupted by exit.
+		while (r.pendingWrite.valid()) {
+			r.pendingWrite.wait();
+			WriteBands();
+		}
+		if (r.writtenBands < r.bandCount)
+			r.isFailed = true;
+		if (!r.writer->Close())
+			r.isFailed = true;
+
+		r.framebuffer.Delete();
+
+		if (r.isFailed)
+			log.Error("Tiled render to ", r.fileName, " failed");
+		else
+			log.Information("Tiled render saved to ", r.fileName, " in ", std::chrono::duration<float>(std::chrono::steady_clock::now() - r.started).count(), " s");
+
+		tiledRender.reset();
 	}
 
 	void RenderToFileAdvanced() {
-		if (!shouldSaveAdvancedImage.Get())
+		if (shouldSaveAdvancedImage.Get()) {
+			shouldSaveAdvancedImage = false;
+
+			if (tiledRender)
+				log.Warning("Tiled render is already in progress");
+			else
+				StartTiledRender();
+		}
+
+		if (!tiledRender)
 			return;
 
-		shouldSaveAdvancedImage = false;
+		WriteBands();
+
+		if (tiledRender->renderedBands < tiledRender->bandCount) {
+			if (tiledRender->renderedBands - tiledRender->writtenBands < maxBandsInFlight)
+				RenderTiledBand();
+		}
+		else if (tiledRender->writtenBands == tiledRender->bandCount)
+			FinishTiledRender();
+	}
+	// Renders frames along a camera path offscreen in the size of the view.
+	// Frames are read back asynchronously, then encoded to numbered PNGs by the encoder pool
+	// or piped in order to ffmpeg.
+	struct SequenceExport {
+		OffscreenFramebuffer framebuffer;
+		CameraPath path;
+		int frameRate;
+		int frameCount;
+		int renderedFrames = 0;
+		int savedFrames = 0;
+
+		// A directory for images or a video file.
+		std::string fileName;
+		std::shared_ptr<VideoPipeWriter> video;
+		std::future<bool> pendingWrite;
+		// Frames waiting for the previous one to be written to ffmpeg.
+		std::deque<std::shared_ptr<Image>> queuedFrames;
+		bool isFailed = false;
+		std::chrono::steady_clock::time_point started;
+
+		// Seconds
+		float GetRemainingTime() const {
+			auto elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - started).count();
+			return savedFrames == 0 ? 0 : elapsed / savedFrames * (frameCount - savedFrames);
+		}
+	};
+	std::unique_ptr<SequenceExport> sequenceExport;
+	// Frames rendered per update of the window.
+	const int sequenceFramesPerUpdate = 4;
+	// Rendering waits while this many frames are being read back or encoded.
+	const int maxSequenceFramesInFlight = 16;
+
+	bool StartSequenceExport() {
+		auto e = std::make_unique<SequenceExport>();
+		if (!e->path.Load(Settings::SequenceExportPath().Get())) {
+			log.Error("Failed to load camera path ", Settings::SequenceExportPath().Get());
+			return false;
+		}
+
+		auto size = glm::ivec2(RenderSize.Get());
+		e->frameRate = Settings::SequenceExportFrameRate().Get();
+		// The settings file isn't validated like the settings window.
+		if (e->frameRate <= 0) {
+			log.Error("Sequence export frame rate must be positive, got ", e->frameRate);
+			return false;
+		}
+		e->frameCount = (int)(e->path.GetDuration() * e->frameRate) + 1;
+
+		std::stringstream ss;
+		ss << "sequence_" << Time::GetTime();
+		if (Settings::SequenceExportTarget().Get() == "video") {
+			e->fileName = ss.str() + ".mp4";
+			e->video = std::make_shared<VideoPipeWriter>();
+			if (!e->video->Open(e->fileName, size.x, size.y, e->frameRate)) {
+				log.Error("Failed to start ffmpeg");
+				return false;
+			}
+		}
+		else {
+			e->fileName = ss.str();
+			std::error_code error;
+			if (!fs::create_directories(e->fileName, error)) {
+				log.Error("Failed to create directory ", e->fileName);
+				return false;
+			}
+		}
 
-		auto copyRenderSize = RenderSize.Get();
-		auto nrs = glm::vec2(4000, 4000);
+		if (!e->framebuffer.Create(size)) {
+			log.Error("Sequence export framebuffer is incomplete");
+			e->framebuffer.Delete();
+			if (e->video)
+				e->video->Close();
+			return false;
+		}
 
-		ResizeCustomRenderCanvas(nrs);
-		onResize.Invoke();
+		e->started = std::chrono::steady_clock::now();
+		sequenceExport = std::move(e);
 
-		bindFrameBuffer(fbo, RenderSize->x, RenderSize->y);
+		log.Information("Sequence export of ", sequenceExport->frameCount, " frames to ", sequenceExport->fileName, " started");
+		return true;
+	}
 
+	void SaveSequenceFrame(int index, Image&& image) {
+		auto& e = *sequenceExport;
 
-		customRenderFunc();
+		if (e.video) {
+			// Readbacks complete in order so frames reach ffmpeg in order.
+			e.queuedFrames.push_back(std::make_shared<Image>(std::move(image)));
+			WriteSequenceFrames();
+			return;
+		}
 
 		std::stringstream ss;
-		ss << "image_" << Time::GetTime() << "a.png";
-		saveImage(ss.str().c_str(), RenderSize->x, RenderSize->y);
+		ss << e.fileName << "/frame_" << std::setw(5) << std::setfill('0') << index << ".png";
+		encoder.Encode(std::move(image), ss.str(), [this](bool isSaved) {
+			if (!sequenceExport)
+				return;
+
+			sequenceExport->savedFrames++;
+			if (!isSaved)
+				sequenceExport->isFailed = true;
+		});
+	}
+
+	// Polls the frame being written the way readbacks are polled
+	// so the main loop never waits for the ffmpeg pipe.
+	// A frame counts as saved when it is written, which limits the frames in flight.
+	void WriteSequenceFrames() {
+		auto& e = *sequenceExport;
+
+		while (true) {
+			if (e.pendingWrite.valid()) {
+				if (e.pendingWrite.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+					return;
+
+				if (!e.pendingWrite.get())
+					e.isFailed = true;
+				e.savedFrames++;
+			}
+
+			if (e.queuedFrames.empty())
+				return;
 
-		ResizeCustomRenderCanvas(copyRenderSize);
-		onResize.Invoke();
+			auto frame = e.queuedFrames.front();
+			e.queuedFrames.pop_front();
+			e.pendingWrite = std::async(std::launch::async, [video = e.video, frame] {
+				return video->Write(*frame);
+			});
+		}
 	}
+
+	void RenderSequenceFrames() {
+		auto& e = *sequenceExport;
+
+		for (int i = 0; i < sequenceFramesPerUpdate && e.renderedFrames < e.frameCount; i++) {
+			if (e.renderedFrames - e.savedFrames >= maxSequenceFramesInFlight)
+				break;
+
+			auto index = e.renderedFrames++;
+			bindFrameBuffer(e.framebuffer.fbo, e.framebuffer.size.x, e.framebuffer.size.y);
+			renderFromPosition(e.path.At((double)index / e.frameRate));
+
+			readback.Read(e.framebuffer.fbo, e.framebuffer.size.x, e.framebuffer.size.y, [this, index](Image&& image) {
+				SaveSequenceFrame(index, std::move(image));
+			});
+
+			if (e.renderedFrames % e.frameRate == 0)
+				log.Information("Sequence export: ", e.renderedFrames, " of ", e.frameCount, " frames rendered, ", e.GetRemainingTime(), " s left");
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void FinishSequenceExport() {
+		auto& e = *sequenceExport;
+		// Frames already read back are written when the export is interrupted by exit.
+		while (e.pendingWrite.valid()) {
+			e.pendingWrite.wait();
+			WriteSequenceFrames();
+		}
+		if (e.video && !e.video->Close())
+			e.isFailed = true;
+		if (e.savedFrames < e.frameCount)
+			e.isFailed = true;
+
+		e.framebuffer.Delete();
+
+		if (e.isFailed)
+			log.Error("Sequence export to ", e.fileName, " failed");
+		else
+			log.Information("Sequence exported to ", e.fileName, " in ", std::chrono::duration<float>(std::chrono::steady_clock::now() - e.started).count(), " s");
+
+		sequenceExport.reset();
+		onSequenceExportFinished();
+	}
+
+	void ExportSequence() {
+		if (shouldExportSequence.Get()) {
+			shouldExportSequence = false;
+
+			if (sequenceExport)
+				log.Warning("Sequence export is already in progress");
+			else
+				StartSequenceExport();
+		}
+
+		if (!sequenceExport)
+			return;
+
+		if (sequenceExport->video)
+			WriteSequenceFrames();
+
+		if (sequenceExport->renderedFrames < sequenceExport->frameCount)
+			RenderSequenceFrames();
+		else if (sequenceExport->savedFrames == sequenceExport->frameCount)
+			FinishSequenceExport();
+	}
+
 	void RenderToFileBasic() {
 		if (!shouldSaveViewportImage.Get())
 			return;
@@ -155,14 +511,21 @@ class CustomRenderWindow : Window {
 
 		std::stringstream ss;
 		ss << "image_" << Time::GetTime() << ".png";
-		saveImage(ss.str().c_str(), RenderSize->x, RenderSize->y);
+		saveImage(ss.str(), RenderSize->x, RenderSize->y);
 	}
 public:
 	std::function<bool()> customRenderFunc;
+	// Renders the scene seen from the camera position. Used by sequence export.
+	std::function<bool(const glm::vec3&)> renderFromPosition;
+	// Projections are left at the last exported frame until the export ends.
+	std::function<void()> onSequenceExportFinished = [] {};
+	// Keeps frames coming while screenshots are being saved.
+	std::function<void()> requestRedraw = [] {};
 	Property<glm::vec2> RenderSize;
 
 	Property<bool> shouldSaveViewportImage;
 	Property<bool> shouldSaveAdvancedImage;
+	Property<bool> shouldExportSequence;
 
 	IEvent<>& OnResize() {
 		return onResize;
@@ -194,6 +557,8 @@ public:
 	}
 
 	virtual bool Design() {
+		GPUProfiler::Scope profilerScope("scene window");
+
 		auto name = LocaleProvider::Get(Window::name) + "###" + Window::name;
 		ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, glm::vec2());
 		
@@ -207,7 +572,12 @@ public:
 		ImGui::PopStyleColor(2);
 		ImGui::PopStyleVar();
 
+		readback.Poll();
+		if (readback.GetPendingCount() > 0 || encoder.GetPendingCount() > 0 || tiledRender || sequenceExport)
+			requestRedraw();
+
 		RenderToFileAdvanced();
+		ExportSequence();
 		bindFrameBuffer(fbo, RenderSize->x, RenderSize->y);
 		if (!customRenderFunc())
 			return false;
@@ -224,6 +594,11 @@ public:
 	
 		Input::IsCustomRenderImageActive() = ImGui::IsItemActive();
 
+		if (sequenceExport) {
+			ImGui::SetCursorPos(ImGui::GetWindowContentRegionMin());
+			ImGui::Text(LocaleProvider::GetC("sequenceExportProgress"), sequenceExport->savedFrames, sequenceExport->frameCount, sequenceExport->GetRemainingTime());
+		}
+
 		HandleResize();
 
 		ImGui::End();
@@ -232,6 +607,12 @@ public:
 	}
 
 	virtual bool OnExit() {
+		readback.Poll(true);
+		if (tiledRender)
+			FinishTiledRender();
+		if (sequenceExport)
+			FinishSequenceExport();
+		readback.Clear();
 		glDeleteFramebuffers(1, &fbo);
 		glDeleteTextures(1, &texture);
 
@@ -322,13 +703,39 @@ class SceneObjectInspectorWindow : Window, MoveCommand::IHolder {
 
 	MoveCommand* moveCommand;
 
-	static int& GetID() {
-		static int val = 0;
-		return val;
-	}
+	enum RowType {
+		ObjectRow,
+		// Placeholder that reveals more children of a large group.
+		MoreRow,
+	};
+	struct Row {
+		RowType type;
+		SceneObject* object;
+		// Position in the parent's children.
+		// For MoreRow the number of children already shown.
+		int pos;
+		int depth;
+	};
+
+	// Flattened visible part of the tree.
+	// Rebuilt only when the hierarchy, expansion state or filter changes.
+	std::vector<Row> rows;
+	bool shouldRebuildRows = true;
+	size_t builtHierarchyVersion = 0;
+	SceneObject* builtRoot = nullptr;
+	std::string builtFilter;
+	std::string filter;
+
+	std::set<ObjectHandle> expanded;
+	// Number of children shown for groups larger than childrenPageSize.
+	std::map<ObjectHandle, size_t> shownChildren;
+
+	bool IsMovedToItself(const SceneObject* target, const ObjectSelection::Selection& buffer) {
+		for (auto& h : buffer) {
+			PON o(h);
+			if (!o.HasValue())
+				continue;
 
-	bool IsMovedToItself(const SceneObject* target, std::set<PON>& buffer) {
-		for (auto o : buffer) {
 			if (o.Get() == target)
 				return true;
 			else if (auto parent = target->GetParent();
@@ -405,7 +812,7 @@ class SceneObjectInspectorWindow : Window, MoveCommand::IHolder {
 			// We can't move object into itself
 			if (IsMovedToItself(o, *buffer)) {
 				ImGui::EndDragDropTarget();
-				buffer->clear();
+				ObjectSelection::RemoveAll();
 				return true;
 			}
 
@@ -421,7 +828,8 @@ class SceneObjectInspectorWindow : Window, MoveCommand::IHolder {
 	}
 
 	bool TreeNode(SceneObject* t, bool& isSelected, int flags = 0) {
-		isSelected = exists(ObjectSelection::Selected(), t, std::function([](const PON& o) { return o.Get(); }));
+		// The node flag avoids scanning the whole selection for every visible row.
+		isSelected = PON(t->GetHandle()).IsSelected();
 		if (isSelected) {
 			ImGui::PushStyleColor(ImGuiCol_Header, selectedColor);
 			ImGui::PushStyleColor(ImGuiCol_HeaderHovered, selectedHoveredColor);
@@ -447,64 +855,142 @@ class SceneObjectInspectorWindow : Window, MoveCommand::IHolder {
 		DragDropBuffer::EmplaceDragDropSelected("SceneObjects");
 	}
 
-	bool DesignRootNode(GroupObject* t) {
-		if (t == nullptr) {
-			ImGui::Text("No scene loaded. Nothing to show");
-			return true;
-		}
+	bool IsExpanded(SceneObject* o) {
+		return exists(expanded, o->GetHandle());
+	}
+	void SetExpanded(SceneObject* o, bool isExpanded) {
+		if (isExpanded)
+			expanded.emplace(o->GetHandle());
+		else
+			expanded.erase(o->GetHandle());
 
-		ImGui::PushID(GetID()++);
+		shouldRebuildRows = true;
+	}
+	size_t GetShownChildren(SceneObject* o) {
+		if (auto v = shownChildren.find(o->GetHandle()); v != shownChildren.end())
+			return v->second;
 
-		ImGui::PushStyleColor(ImGuiCol_Header, unselectedColor);
-		ImGuiDragDropFlags target_flags = ImGuiTreeNodeFlags_DefaultOpen | ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_Bullet;
-		bool isSelected;
-		bool open = TreeNode(t, isSelected, target_flags);
+		return childrenPageSize;
+	}
 
-		!TryDragDropTarget(t, 0, Center) && !TryDragDropSource(t, isSelected) && TrySelect(t, isSelected);
+	static std::string ToLower(std::string s) {
+		std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+		return s;
+	}
 
-		for (int i = 0; i < t->children.size(); i++)
-			if (!DesignTreeNode(t->children[i], t->children, i)) {
-				ImGui::TreePop();
-				ImGui::PopID();
+	void AddRows(SceneObject* o, int pos, int depth) {
+		rows.push_back({ ObjectRow, o, pos, depth });
 
-				return false;
-			}
+		// Root is always expanded.
+		if (depth > 0 && !IsExpanded(o))
+			return;
 
-		ImGui::TreePop();
-		ImGui::PopStyleColor();
-		ImGui::PopID();
+		auto count = std::min(o->children.size(), GetShownChildren(o));
+		for (size_t i = 0; i < count; i++)
+			AddRows(o->children[i], i, depth + 1);
 
-		return true;
+		if (count < o->children.size())
+			rows.push_back({ MoreRow, o, (int)count, depth + 1 });
 	}
-	bool DesignTreeNode(SceneObject* t, std::vector<SceneObject*>& source, int pos) {
-		ImGui::PushID(GetID()++);
+	// Adds objects whose name contains the filter along with their ancestors.
+	bool AddFilteredRows(SceneObject* o, int pos, int depth, const std::string& lowerFilter) {
+		auto rowCount = rows.size();
+		rows.push_back({ ObjectRow, o, pos, depth });
 
-		ImGui::Indent(indent);
+		bool hasMatch = ToLower(o->Name).find(lowerFilter) != std::string::npos;
+		for (size_t i = 0; i < o->children.size(); i++)
+			hasMatch |= AddFilteredRows(o->children[i], i, depth + 1, lowerFilter);
 
-		bool isSelected;
-		bool open = TreeNode(t, isSelected);
+		if (!hasMatch && depth > 0)
+			rows.resize(rowCount);
 
-		ImGuiDragDropFlags src_flags = 0;
-		src_flags |= ImGuiDragDropFlags_SourceNoDisableHover;     // Keep the source displayed as hovered
-		src_flags |= ImGuiDragDropFlags_SourceNoHoldToOpenOthers; // Because our dragging is local, we disable the feature of opening foreign treenodes/tabs while dragging
-		//src_flags |= ImGuiDragDropFlags_SourceNoPreviewTooltip; // Hide the tooltip
+		return hasMatch;
+	}
+	void RebuildRowsIfNeeded(SceneObject* root) {
+		if (!shouldRebuildRows
+			&& builtHierarchyVersion == SceneObject::HierarchyVersion()
+			&& builtRoot == root
+			&& builtFilter == filter)
+			return;
 
-		!TryDragDropTarget(t, pos, Any) && !TryDragDropSource(t, isSelected, src_flags) && TrySelect(t, isSelected);
+		rows.clear();
+		if (filter.empty())
+			AddRows(root, 0, 0);
+		else
+			AddFilteredRows(root, 0, 0, ToLower(filter));
 
-		if (open) {
-			for (int i = 0; i < t->children.size(); i++)
-				if (!DesignTreeNode(t->children[i], t->children, i)) {
-					ImGui::TreePop();
-					ImGui::PopID();
+		shouldRebuildRows = false;
+		builtHierarchyVersion = SceneObject::HierarchyVersion();
+		builtRoot = root;
+		builtFilter = filter;
+	}
 
-					return false;
-				}
+	void DesignRow(const Row& row) {
+		auto t = row.object;
 
-			ImGui::TreePop();
+		ImGui::PushID(t);
+		if (row.depth > 0)
+			ImGui::Indent(row.depth * (indent + ImGui::GetStyle().IndentSpacing));
+
+		if (row.type == MoreRow) {
+			ImGui::PushID(-1);
+			std::stringstream ss;
+			ss << LocaleProvider::Get("showMore") << " (" << t->children.size() - row.pos << ")";
+			if (ImGui::Selectable(ss.str().c_str(), false, 0, glm::vec2(0, ImGui::GetFrameHeight()))) {
+				shownChildren[t->GetHandle()] = row.pos + childrenPageSize;
+				shouldRebuildRows = true;
+			}
+			ImGui::PopID();
+		}
+		else if (row.depth == 0) {
+			bool isSelected;
+			TreeNode(t, isSelected, ImGuiTreeNodeFlags_DefaultOpen | ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_Bullet | ImGuiTreeNodeFlags_NoTreePushOnOpen);
+
+			!TryDragDropTarget(t, 0, Center) && !TryDragDropSource(t, isSelected) && TrySelect(t, isSelected);
 		}
+		else {
+			bool isExpanded = !filter.empty() || IsExpanded(t);
+			if (!t->children.empty())
+				ImGui::SetNextItemOpen(isExpanded);
 
-		ImGui::Unindent(indent);
+			bool isSelected;
+			bool open = TreeNode(t, isSelected, ImGuiTreeNodeFlags_NoTreePushOnOpen);
+
+			// Expansion is fixed while the tree is filtered.
+			if (!t->children.empty() && filter.empty() && open != isExpanded)
+				SetExpanded(t, open);
+
+			ImGuiDragDropFlags src_flags = 0;
+			src_flags |= ImGuiDragDropFlags_SourceNoDisableHover;     // Keep the source displayed as hovered
+			src_flags |= ImGuiDragDropFlags_SourceNoHoldToOpenOthers; // Because our dragging is local, we disable the feature of opening foreign treenodes/tabs while dragging
+			//src_flags |= ImGuiDragDropFlags_SourceNoPreviewTooltip; // Hide the tooltip
+
+			!TryDragDropTarget(t, row.pos, Any) && !TryDragDropSource(t, isSelected, src_flags) && TrySelect(t, isSelected);
+		}
+
+		if (row.depth > 0)
+			ImGui::Unindent(row.depth * (indent + ImGui::GetStyle().IndentSpacing));
 		ImGui::PopID();
+	}
+	bool DesignTree(SceneObject* root) {
+		if (root == nullptr) {
+			ImGui::Text("No scene loaded. Nothing to show");
+			return true;
+		}
+
+		RebuildRowsIfNeeded(root);
+
+		ImGui::PushStyleColor(ImGuiCol_Header, unselectedColor);
+
+		// Only rows inside the visible region are submitted.
+		ImGuiListClipper clipper;
+		clipper.Begin((int)rows.size());
+		while (clipper.Step())
+			for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+				DesignRow(rows[i]);
+		clipper.End();
+
+		ImGui::PopStyleColor();
 
 		return true;
 	}
@@ -552,7 +1038,7 @@ class SceneObjectInspectorWindow : Window, MoveCommand::IHolder {
 		return Rest;
 	}
 
-	void ScheduleMove(SceneObject* target, int targetPos, std::set<PON>* items, InsertPosition pos) {
+	void ScheduleMove(SceneObject* target, int targetPos, const ObjectSelection::Selection* items, InsertPosition pos) {
 		if (isCommandEmpty) {
 			moveCommand = new MoveCommand();
 			isCommandEmpty = false;
@@ -574,6 +1060,8 @@ public:
 	Input* input;
 	float indent = 1;
 	float centerSizeHalf = 3;
+	// Groups with more children show them in pages of this size.
+	size_t childrenPageSize = 500;
 
 	// We divide height by this number. 
 	// For some reason height/2 isn't center.
@@ -587,10 +1075,11 @@ public:
 		auto name = LocaleProvider::Get(Window::name) + "###" + Window::name;
 		ImGui::Begin(name.c_str());
 
-		// Reset elements' IDs.
-		GetID() = 0;
+		ImGui::InputText(LocaleProvider::GetC("search"), &filter);
 
-		DesignRootNode((GroupObject*)rootObject.Get().Get());
+		ImGui::BeginChild("objectInspectorTree");
+		DesignTree(rootObject.Get().Get());
+		ImGui::EndChild();
 		hasMovementOccured = false;
 
 		ImGui::End();
@@ -1539,6 +2028,8 @@ public:
 
 	Property<bool> IsOpen;
 
+	std::function<void()> benchmarkPositionDetectors = [] {};
+
 
 	virtual bool Init() {
 		Window::name = "settingsWindow";
@@ -1616,6 +2107,120 @@ public:
 			ImGui::DragFloat(LocaleProvider::GetC(Settings::Name(&Settings::CustomRenderWindowAlpha)), &v, 0.01, 0, 1))
 			Settings::CustomRenderWindowAlpha() = v;
 
+		if (auto v = Settings::PositionDetectionSource().Get();
+			ImGui::InputText(LocaleProvider::GetC(Settings::Name(&Settings::PositionDetectionSource)), &v))
+			Settings::PositionDetectionSource() = v;
+		ImGui::SameLine(); ImGui::Extensions::HelpMarker(LocaleProvider::GetC("positionDetectionSourceHelp"));
+
+		if (auto v = Settings::PositionRecordFileName().Get();
+			ImGui::InputText(LocaleProvider::GetC(Settings::Name(&Settings::PositionRecordFileName)), &v))
+			Settings::PositionRecordFileName() = v;
+
+		if (auto v = Settings::PositionDetectorBackend().Get();
+			ImGui::TreeNode((LocaleProvider::Get(Settings::Name(&Settings::PositionDetectorBackend)) + ": " + v).c_str())) {
+
+			for (auto name : { "haar", "lbp", "dnn" })
+				if (auto i = v == name; ImGui::Selectable(name, &i))
+					Settings::PositionDetectorBackend() = name;
+
+			ImGui::TreePop();
+		}
+
+		if (auto v = Settings::ShouldDetectEyes().Get();
+			ImGui::Checkbox(LocaleProvider::GetC(Settings::Name(&Settings::ShouldDetectEyes)), &v))
+			Settings::ShouldDetectEyes() = v;
+
+		if (ImGui::Button(LocaleProvider::GetC("benchmarkPositionDetectors")))
+			benchmarkPositionDetectors();
+		ImGui::SameLine(); ImGui::Extensions::HelpMarker(LocaleProvider::GetC("benchmarkPositionDetectorsHelp"));
+
+		if (auto v = Settings::TrackerRatePolicy().Get();
+			ImGui::TreeNode((LocaleProvider::Get("trackerRatePolicy:trackerRatePolicy") + ": " + LocaleProvider::Get("trackerRatePolicy:" + v)).c_str())) {
+
+			for (auto name : { "maximum", "adaptive" })
+				if (auto i = v == name; ImGui::Selectable(LocaleProvider::GetC(std::string("trackerRatePolicy:") + name), &i))
+					Settings::TrackerRatePolicy() = name;
+
+			ImGui::TreePop();
+		}
+		ImGui::SameLine(); ImGui::Extensions::HelpMarker(LocaleProvider::GetC("trackerRatePolicyHelp"));
+
+		if (auto v = Settings::TargetFrameRate().Get();
+			ImGui::InputInt(LocaleProvider::GetC(Settings::Name(&Settings::TargetFrameRate)), &v, 1, 10) && v > 0)
+			Settings::TargetFrameRate() = v;
+
+		if (auto v = Settings::ShouldPinThreads().Get();
+			ImGui::Checkbox(LocaleProvider::GetC(Settings::Name(&Settings::ShouldPinThreads)), &v))
+			Settings::ShouldPinThreads() = v;
+		ImGui::SameLine(); ImGui::Extensions::HelpMarker(LocaleProvider::GetC("shouldPinThreadsHelp"));
+
+		if (int v[] = { Settings::AdvancedRenderWidth().Get(), Settings::AdvancedRenderHeight().Get() };
+			ImGui::InputInt2(LocaleProvider::GetC("advancedRenderSize"), v) && v[0] > 0 && v[1] > 0) {
+			Settings::AdvancedRenderWidth() = v[0];
+			Settings::AdvancedRenderHeight() = v[1];
+		}
+		if (auto v = Settings::AdvancedRenderFormat().Get();
+			ImGui::TreeNode((LocaleProvider::Get(Settings::Name(&Settings::AdvancedRenderFormat)) + ": " + v).c_str())) {
+
+			for (auto name : { "png", "tiff" })
+				if (auto i = v == name; ImGui::Selectable(name, &i))
+					Settings::AdvancedRenderFormat() = name;
+
+			ImGui::TreePop();
+		}
+
+		if (auto v = Settings::SequenceExportPath().Get();
+			ImGui::InputText(LocaleProvider::GetC(Settings::Name(&Settings::SequenceExportPath)), &v))
+			Settings::SequenceExportPath() = v;
+		ImGui::SameLine(); ImGui::Extensions::HelpMarker(LocaleProvider::GetC("sequenceExportPathHelp"));
+		if (auto v = Settings::SequenceExportFrameRate().Get();
+			ImGui::InputInt(LocaleProvider::GetC(Settings::Name(&Settings::SequenceExportFrameRate)), &v, 1, 10) && v > 0)
+			Settings::SequenceExportFrameRate() = v;
+		if (auto v = Settings::SequenceExportTarget().Get();
+			ImGui::TreeNode((LocaleProvider::Get(Settings::Name(&Settings::SequenceExportTarget)) + ": " + v).c_str())) {
+
+			for (auto name : { "png", "video" })
+				if (auto i = v == name; ImGui::Selectable(name, &i))
+					Settings::SequenceExportTarget() = name;
+
+			ImGui::TreePop();
+		}
+		ImGui::SameLine(); ImGui::Extensions::HelpMarker(LocaleProvider::GetC("sequenceExportTargetHelp"));
+
+		if (auto v = Settings::ShouldRenderOnDemand().Get();
+			ImGui::Checkbox(LocaleProvider::GetC(Settings::Name(&Settings::ShouldRenderOnDemand)), &v))
+			Settings::ShouldRenderOnDemand() = v;
+		ImGui::SameLine(); ImGui::Extensions::HelpMarker(LocaleProvider::GetC("shouldRenderOnDemandHelp"));
+
+		if (auto v = Settings::LineRenderMode().Get();
+			ImGui::TreeNode((LocaleProvider::Get("lineRenderMode:lineRenderMode") + ": " + LocaleProvider::Get("lineRenderMode:" + v)).c_str())) {
+
+			for (auto name : { "stencil", "smooth" })
+				if (auto i = v == name; ImGui::Selectable(LocaleProvider::GetC(std::string("lineRenderMode:") + name), &i))
+					Settings::LineRenderMode() = name;
+
+			ImGui::TreePop();
+		}
+		ImGui::SameLine(); ImGui::Extensions::HelpMarker(LocaleProvider::GetC("lineRenderModeHelp"));
+		if (auto v = Settings::LineThickness().Get();
+			ImGui::DragFloat(LocaleProvider::GetC(Settings::Name(&Settings::LineThickness)), &v, 0.1, 0.5, 10) && v > 0)
+			Settings::LineThickness() = v;
+		if (auto v = Settings::LevelOfDetailError().Get();
+			ImGui::DragFloat(LocaleProvider::GetC(Settings::Name(&Settings::LevelOfDetailError)), &v, 0.05, 0, 4) && v >= 0)
+			Settings::LevelOfDetailError() = v;
+		ImGui::SameLine(); ImGui::Extensions::HelpMarker(LocaleProvider::GetC("levelOfDetailErrorHelp"));
+
+		if (auto v = Settings::StereoOutputMode().Get();
+			ImGui::TreeNode((LocaleProvider::Get("stereoOutputMode:stereoOutputMode") + ": " + LocaleProvider::Get("stereoOutputMode:" + v)).c_str())) {
+
+			for (auto name : { "anaglyph", "sideBySide", "topBottom", "interlaced", "dualWindow" })
+				if (auto i = v == name; ImGui::Selectable(LocaleProvider::GetC(std::string("stereoOutputMode:") + name), &i))
+					Settings::StereoOutputMode() = name;
+
+			ImGui::TreePop();
+		}
+		ImGui::SameLine(); ImGui::Extensions::HelpMarker(LocaleProvider::GetC("stereoOutputModeHelp"));
+
 		//ImGui::SameLine(); ImGui::Extensions::HelpMarker("Requires restart.\n");
 
 		ImGui::End();
@@ -1627,6 +2232,123 @@ public:
 
 };
 
+// GPU time and GL statistics of the phases of a frame averaged over the recent frames.
+class ProfilerWindow : Window {
+	const Log log = Log::For<ProfilerWindow>();
+
+	struct Row {
+		GPUProfiler::Phase average;
+		double maxMilliseconds = 0;
+		size_t frameCount = 0;
+	};
+
+	// Frames averaged in the table.
+	const size_t averagedFrameCount = 60;
+
+	// Phases are kept in the order they are entered so nested ones follow their parents.
+	std::vector<Row> getRows() {
+		std::vector<Row> rows;
+
+		auto& history = GPUProfiler::History();
+		auto first = history.size() > averagedFrameCount ? history.size() - averagedFrameCount : 0;
+		for (auto i = first; i < history.size(); i++)
+			for (auto& phase : history[i].phases) {
+				auto row = std::find_if(rows.begin(), rows.end(), [&](const Row& r) {
+					return r.average.depth == phase.depth && r.average.name == phase.name;
+					});
+				if (row == rows.end()) {
+					rows.push_back({ { phase.name, phase.depth } });
+					row = rows.end() - 1;
+				}
+
+				row->average.milliseconds += phase.milliseconds;
+				row->average.drawCalls += phase.drawCalls;
+				row->average.bufferUploads += phase.bufferUploads;
+				row->average.bytesUploaded += phase.bytesUploaded;
+				if (phase.milliseconds > row->maxMilliseconds)
+					row->maxMilliseconds = phase.milliseconds;
+				row->frameCount++;
+			}
+
+		for (auto& row : rows) {
+			row.average.milliseconds /= row.frameCount;
+			row.average.drawCalls /= row.frameCount;
+			row.average.bufferUploads /= row.frameCount;
+			row.average.bytesUploaded /= row.frameCount;
+		}
+
+		return rows;
+	}
+
+	void exportHistory() {
+		std::stringstream ss;
+		ss << "profile_" << Time::GetTime() << ".csv";
+
+		if (GPUProfiler::Export(ss.str()))
+			log.Information("Profile saved to ", ss.str());
+		else
+			log.Error("Failed to save profile to ", ss.str());
+	}
+
+public:
+	Property<bool> IsOpen;
+
+	virtual bool Init() {
+		Window::name = "profilerWindow";
+
+		return true;
+	}
+	virtual bool Design() {
+		if (!IsOpen.Get())
+			return true;
+
+		auto windowName = LocaleProvider::Get(Window::name) + "###" + Window::name;
+		if (!ImGui::Begin(windowName.c_str(), &IsOpen.Get())) {
+			ImGui::End();
+			return true;
+		}
+
+		if (ImGui::Button(LocaleProvider::GetC("profilerExport")))
+			exportHistory();
+		ImGui::SameLine();
+		if (ImGui::Button(LocaleProvider::GetC("profilerClear")))
+			GPUProfiler::Clear();
+
+		if (ImGui::BeginTable("phases", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable)) {
+			for (auto column : { "profilerPhase", "profilerGPUTime", "profilerMaxGPUTime", "profilerDraws", "profilerUploads", "profilerUploadedKB" })
+				ImGui::TableSetupColumn(LocaleProvider::GetC(column));
+			ImGui::TableHeadersRow();
+
+			for (auto& row : getRows()) {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Indent(row.average.depth * ImGui::GetStyle().IndentSpacing + 1);
+				ImGui::TextUnformatted(row.average.name.c_str());
+				ImGui::Unindent(row.average.depth * ImGui::GetStyle().IndentSpacing + 1);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", row.average.milliseconds);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", row.maxMilliseconds);
+				ImGui::TableNextColumn();
+				ImGui::Text("%i", (int)row.average.drawCalls);
+				ImGui::TableNextColumn();
+				ImGui::Text("%i", (int)row.average.bufferUploads);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", row.average.bytesUploaded / 1024.f);
+			}
+
+			ImGui::EndTable();
+		}
+
+		ImGui::End();
+
+		return true;
+	}
+	virtual bool OnExit() {
+		return true;
+	}
+};
+
 class LogWindow : Window {
 	const Log log = Log::For<LogWindow>();
 public:
@@ -18,17 +18,24 @@
 
 using namespace std;
 
+// Millimeters. Smaller changes of measured eye distance are ignored.
+const float eyeToCenterDistanceThreshold = 0.5;
+
 bool CustomRenderFunc(Scene& scene, Renderer& renderPipeline, PositionDetector& positionDetector) {
 	// Modify camera posiiton when Posiiton detection is enabled.
-	if (positionDetector.isPositionProcessingWorking)
-		scene.camera->PositionModifier =
-		glm::vec3(
-			positionDetector.positionHorizontal.load(),
-			positionDetector.positionVertical.load(),
-			positionDetector.distance.load());
+	if (positionDetector.isPositionProcessingWorking) {
+		scene.camera->PositionModifier = positionDetector.GetHeadPosition();
+
+		if (auto v = positionDetector.GetEyeToCenterDistance();
+			Settings::ShouldDetectEyes().Get() && v > 0 && abs(v - scene.camera->EyeToCenterDistance.Get()) > eyeToCenterDistanceThreshold)
+			scene.camera->EyeToCenterDistance = v;
+	}
 
 	// Run scene drawing.
 	renderPipeline.Pipeline(scene);
+
+	if (!renderPipeline.PresentEyeWindows())
+		Settings::StereoOutputMode() = Renderer::GetStereoOutputModeName(StereoOutputMode::Anaglyph);
 	
 	return true;
 }
@@ -89,6 +96,7 @@ int main() {
 
 	SettingsWindow settingsWindow;
 	settingsWindow.IsOpen = true;
+	ProfilerWindow profilerWindow;
 
 	Renderer renderPipeline;
 	GUI gui;
@@ -124,14 +132,17 @@ int main() {
 		(Window*)&attributesWindow,
 		(Window*)&toolWindow,
 		(Window*)&settingsWindow,
+		(Window*)&profilerWindow,
 		//(Window*)&logWindow,
 	};
 	gui.glWindow = renderPipeline.glWindow;
 	gui.glsl_version = renderPipeline.glsl_version;
 	gui.scene = &scene;
 	gui.settingsWindow = &settingsWindow;
+	gui.profilerWindow = &profilerWindow;
 	gui.renderViewport = [&customRenderWindow] { customRenderWindow.shouldSaveViewportImage = true; };
 	gui.renderAdvanced = [&customRenderWindow] { customRenderWindow.shouldSaveAdvancedImage = true; };
+	gui.exportSequence = [&customRenderWindow] { customRenderWindow.shouldExportSequence = true; };
 	if (!gui.Init())
 		return false;
 
@@ -175,9 +186,21 @@ int main() {
 	// Position detector doesn't initialize itself
 	// so we need to help it.
 	positionDetector.onStartProcess = [&positionDetector] {
+		positionDetector.source = PositionDetector::CreateSource(Settings::PositionDetectionSource().Get());
+		positionDetector.recordFileName = Settings::PositionRecordFileName().Get();
+		positionDetector.backend = PositionDetector::ParseBackend(Settings::PositionDetectorBackend().Get());
+		positionDetector.shouldDetectEyes = Settings::ShouldDetectEyes().Get();
+		positionDetector.rateController.policy = TrackerRateController::ParsePolicy(Settings::TrackerRatePolicy().Get());
+		positionDetector.rateController.frameBudget = 1.f / Settings::TargetFrameRate().Get();
+		positionDetector.shouldPinThreads = Settings::ShouldPinThreads().Get();
 		positionDetector.Init();
 	};
 
+	// Benchmarks run on the configured video in background.
+	settingsWindow.benchmarkPositionDetectors = [&positionDetector] {
+		positionDetector.StartBenchmark(Settings::PositionDetectionSource().Get());
+	};
+
 	// Track the state of Position detector to switch it
 	// when necessary. 
 	// Reads user position and modifies camera position when enabled.
@@ -196,17 +219,71 @@ int main() {
 	};
 	customRenderWindow.OnResize() += updateCacheForAllObjects;
 	camera.OnPropertiesChanged() += updateCacheForAllObjects;
+	Settings::LevelOfDetailError().OnChanged() += [updateCacheForAllObjects](const float&) { updateCacheForAllObjects(); };
+
+	// Sequence export moves the camera for a frame and restores it
+	// so the scene window is not affected.
+	// Projections are recalculated for the user's position once the export ends
+	// rather than after every frame, the scene window shows the export progress meanwhile.
+	customRenderWindow.renderFromPosition = [&scene, &renderPipeline, &updateCacheForAllObjects](const glm::vec3& position) {
+		auto userPosition = scene.camera->PositionModifier.Get();
+
+		scene.camera->PositionModifier = position;
+		updateCacheForAllObjects();
+		renderPipeline.Pipeline(scene);
+
+		scene.camera->PositionModifier = userPosition;
+		return true;
+	};
+	customRenderWindow.onSequenceExportFinished = updateCacheForAllObjects;
+
+	// Frames are produced only when something visible changes.
+	camera.OnPropertiesChanged() += GUI::RequestRedraw;
+	positionDetector.onPoseChanged = GUI::RequestRedraw;
+	customRenderWindow.requestRedraw = GUI::RequestRedraw;
+	LevelOfDetail::OnAnyBuilt() = GUI::RequestRedraw;
+
+	// Tracking adapts to the time spent on rendering.
+	gui.onFrameRendered = [&positionDetector](float seconds) {
+		positionDetector.rateController.ReportRenderTime(seconds);
+	};
+	auto pinRenderThread = [](const bool& v) {
+		if (v ? !ThreadAffinity::PinRenderThread() : !ThreadAffinity::UnpinCurrentThread())
+			Log::For<GUI>().Warning("Render thread affinity could not be changed");
+	};
+	Settings::ShouldPinThreads().OnChanged() += pinRenderThread;
+	// Pinning is opt-in, the thread is left to the scheduler otherwise.
+	if (Settings::ShouldPinThreads().Get())
+		pinRenderThread(true);
+
+	renderPipeline.lineRenderMode = Renderer::ParseLineRenderMode(Settings::LineRenderMode().Get());
+	renderPipeline.LineThickness = Settings::LineThickness().Get();
+	Settings::LineRenderMode().OnChanged() += [&renderPipeline](const std::string& v) {
+		renderPipeline.lineRenderMode = Renderer::ParseLineRenderMode(v);
+		GUI::RequestRedraw();
+	};
+	Settings::LineThickness().OnChanged() += [&renderPipeline](const float& v) {
+		renderPipeline.LineThickness = v;
+		GUI::RequestRedraw();
+	};
+	renderPipeline.SetOutputMode(Renderer::ParseStereoOutputMode(Settings::StereoOutputMode().Get()));
+	Settings::StereoOutputMode().OnChanged() += [&renderPipeline](const std::string& v) {
+		renderPipeline.SetOutputMode(Renderer::ParseStereoOutputMode(v));
+		GUI::RequestRedraw();
+	};
 
 	ConfigureShortcuts(customRenderWindow);
 
 	// Start the main loop and clean the memory when closed.
 	if (!gui.MainLoop() |
 		!gui.OnExit()) {
+		positionDetector.StopBenchmark();
 		positionDetector.StopPositionDetection();
 		return false;
 	}
 
-	// Stop Position detection thread.
+	// Stop Position detection and benchmark threads.
+	positionDetector.StopBenchmark();
 	positionDetector.StopPositionDetection();
 	StateBuffer::Clear();
 	SettingsLoader::Save();
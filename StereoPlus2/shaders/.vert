@@ -1,6 +1,8 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+// Scale (xy) and offset (zw) of a rendered tile.
+uniform vec4 tileTransform = vec4(1.0, 1.0, 0.0, 0.0);
 void main()
 {
-   gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);
+   gl_Position = vec4(aPos.xy * tileTransform.xy + tileTransform.zw, aPos.z, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,28 @@
+#version 330 core
+
+uniform sampler2D leftEye;
+uniform sampler2D rightEye;
+// 1 side by side, 2 top bottom, 3 interlaced.
+uniform int mode;
+
+in vec2 uv;
+
+out vec4 FragColor;
+
+void main()
+{
+	if (mode == 1)
+		FragColor = uv.x < 0.5
+			? texture(leftEye, vec2(uv.x * 2.0, uv.y))
+			: texture(rightEye, vec2(uv.x * 2.0 - 1.0, uv.y));
+	// The target is shown with its first row on top, so the lower half of uv is the top one.
+	else if (mode == 2)
+		FragColor = uv.y < 0.5
+			? texture(leftEye, vec2(uv.x, uv.y * 2.0))
+			: texture(rightEye, vec2(uv.x, uv.y * 2.0 - 1.0));
+	// Rows are counted from the top of the shown image, eye targets have the size of the output.
+	else
+		FragColor = (textureSize(leftEye, 0).y - 1 - int(gl_FragCoord.y)) % 2 == 0
+			? texture(leftEye, uv)
+			: texture(rightEye, uv);
+}
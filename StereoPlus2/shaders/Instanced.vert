@@ -0,0 +1,20 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// Millimeters, from local vertices of the shared geometry to world ones.
+layout (location = 1) in mat4 instanceTransform;
+// Scale (xy) and offset (zw) of a rendered tile.
+uniform vec4 tileTransform = vec4(1.0, 1.0, 0.0, 0.0);
+// Stereo::GetLeft and Stereo::GetRight in view coordinates.
+uniform vec3 millimetersToView;
+uniform vec3 cameraPosition;
+// Eye position relative to the camera, negative for the left eye.
+uniform float eyeShift;
+void main()
+{
+   vec3 pos = (instanceTransform * vec4(aPos, 1.0)).xyz * millimetersToView;
+   float denominator = cameraPosition.z - pos.z;
+   vec2 projected = vec2(
+      (pos.x * cameraPosition.z - pos.z * (cameraPosition.x + eyeShift)) / denominator,
+      (cameraPosition.z * -pos.y + cameraPosition.y * pos.z) / denominator);
+   gl_Position = vec4(projected * tileTransform.xy + tileTransform.zw, 0.0, 1.0);
+}
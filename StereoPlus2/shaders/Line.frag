@@ -0,0 +1,15 @@
+#version 330 core
+
+uniform vec4 myColor;
+uniform float lineWidth = 1.0;
+
+noperspective in float lineDistance;
+
+out vec4 FragColor;
+
+void main()
+{
+	// Part of the pixel covered by the line.
+	float coverage = clamp(lineWidth * 0.5 + 0.5 - abs(lineDistance), 0.0, 1.0);
+	FragColor = vec4(myColor.rgb * coverage, myColor.a * coverage);
+}